@@ -0,0 +1,136 @@
+#ifndef ADJOINT_HPP
+#define ADJOINT_HPP
+
+// STL includes
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+// user includes
+#include "Surface.hpp"
+
+// Hand written adjoints of the local vol Monte Carlo, without tape (see the *_Adjoint pricers in MC.hpp).
+// A path is simulated in doubles keeping only the spot, vol and interpolation bucket of every step.
+// The payoff gives the adjoints of the spot after each step, and Local_vol_path::reverse() carries them
+// back through the log-Euler steps (the derivatives of local_vol_step() in Fused.hpp), accumulating the
+// local vol adjoints in a dense matrix laid out as the surface, and the adjoint of mu = rate - divs.
+
+// Price and adjoints of an adjoint pricer. lVol is laid out as Get_adjoints_SR(...).lVol.
+// The adjoints of inputs a product does not have are 0.
+struct MC_adjoints
+{
+    double spot   = 0, rate  = 0, divs  = 0, strike = 0;
+    double coupon = 0, upper = 0, lower = 0, anchor = 0;
+    Matrix<double> lVol;
+};
+
+// smoother() of MC.hpp in doubles, with its partials to x, x_pos and x_neg
+inline double smoother_adjoint(
+    const double x, const double x_pos, const double x_neg, const double eps,
+    double& dx, double& dpos, double& dneg)
+{
+    if (eps > 0.0001)
+    {
+        const double a = x + eps / 2.;
+        const double c = std::max(0.0, std::min(eps, a));
+        dx   = 0. < a && a < eps ? (x_pos - x_neg) / eps : 0.;
+        dpos = c / eps;
+        dneg = 1. - c / eps;
+        return x_neg + (x_pos - x_neg) / eps * c;
+    }
+    dx   = 0.;
+    dpos = x > 0 ? 1. : 0.;
+    dneg = 1. - dpos;
+    return x > 0 ? x_pos : x_neg;
+}
+
+class Local_vol_path
+{
+private:
+    const std::vector<double>& my_spots;     // spot grid of the surface
+    std::vector<double> my_spot;             // spot before step j, my_spot[n] at the end
+    std::vector<double> my_vol;              // vol of step j
+    std::vector<size_t> my_bucket;           // surface node left of the spot (or the end node outside the grid)
+    size_t my_n = 0;
+
+public:
+    Local_vol_path(const std::vector<double>& spots_, const size_t steps)
+        : my_spots(spots_), my_spot(steps + 1), my_vol(steps), my_bucket(steps) {}
+
+    // spot after step j
+    double spot(const size_t j) const {return my_spot[j + 1];}
+
+    // Simulates the first n steps from spot0. Values as local_vol_step() in Fused.hpp.
+    void simulate(
+        const double spot0,
+        const Matrix<double>& lVol,
+        const double mu,
+        const std::vector<double>& dts,
+        const double* gaussians,
+        const size_t n)
+    {
+        my_n = n;
+        my_spot[0] = spot0;
+        for (size_t j = 0; j < n; ++j)
+        {
+            const double  s   = my_spot[j];
+            const double* row = lVol[j];
+            auto it = std::upper_bound(my_spots.begin(), my_spots.end(), s);
+
+            const bool inside = it != my_spots.begin() && it != my_spots.end();
+            const size_t b = it == my_spots.end() ? my_spots.size() - 1 : inside ? std::distance(my_spots.begin(), it) - 1 : 0;
+            double vol = row[b];
+            if (inside) vol = vol + (row[b + 1] - row[b]) * ((s - my_spots[b]) / (my_spots[b + 1] - my_spots[b]));
+
+            my_vol[j]       = vol;
+            my_bucket[j]    = b;
+            my_spot[j + 1]  = s * exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * gaussians[j]);
+        }
+    }
+
+    // Reverse loop. spot_adjoints[j] is the adjoint of the spot after step j from the payoff.
+    // Adds to the local vol adjoints and the adjoint of mu, returns the adjoint of spot0.
+    double reverse(
+        const std::vector<double>& spot_adjoints,
+        const Matrix<double>& lVol,
+        const std::vector<double>& dts,
+        const double* gaussians,
+        Matrix<double>& lVol_adjoints,
+        double& mu_adjoint) const
+    {
+        double a_spot = 0;
+        for (size_t j = my_n; j-- > 0;)
+        {
+            a_spot += spot_adjoints[j];
+            if (a_spot == 0.) continue;
+
+            const double s      = my_spot[j];
+            const double value  = my_spot[j + 1];
+            const double vol    = my_vol[j];
+            const size_t b      = my_bucket[j];
+            const double growth = value / s;
+
+            mu_adjoint += a_spot * value * dts[j];
+            const double a_vol = a_spot * value * (sqrt(dts[j]) * gaussians[j] - vol * dts[j]);
+
+            double* row = lVol_adjoints[j];
+            a_spot *= growth;
+            if (my_spots.front() <= s && s < my_spots.back())
+            {
+                const double dx = my_spots[b + 1] - my_spots[b];
+                const double t  = (s - my_spots[b]) / dx;
+                const double* vols = lVol[j];
+                row[b]     += a_vol * (1. - t);
+                row[b + 1] += a_vol * t;
+                a_spot     += a_vol * (vols[b + 1] - vols[b]) / dx;
+            }
+            else
+            {
+                row[b] += a_vol;
+            }
+        }
+        return a_spot;
+    }
+};
+
+#endif
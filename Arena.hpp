@@ -0,0 +1,376 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+// STL includes
+#include <new>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdlib>
+#define ARENA_MMAP 1
+#else
+#define ARENA_MMAP 0
+#endif
+
+namespace containers
+{
+    // Memory of List_array blocks (see List_array.hpp). The tape uses the heap by default, and can be
+    // given an mmap arena for big recordings (see Tape::set_allocator()).
+    class Block_allocator
+    {
+    public:
+        virtual ~Block_allocator() {}
+
+        virtual void* allocate(const size_t bytes) = 0;
+        virtual void  deallocate(void* block, const size_t bytes) = 0;
+        // Called by Tape::clear(), the blocks stay valid
+        virtual void  clear() {}
+        // Called by List_array when a block is full and the next one is in use
+        virtual void  seal(void*, const size_t) {}
+        // Called by the reverse sweep of the tape on blocks it reaches soon
+        virtual void  read_ahead(const void*, const size_t) {}
+    };
+
+    // Blocks from the general heap
+    class Heap_allocator : public Block_allocator
+    {
+    public:
+        void* allocate(const size_t bytes) override {return ::operator new(bytes);}
+        void  deallocate(void* block, const size_t) override {::operator delete(block);}
+
+        static Heap_allocator& instance()
+        {
+            static Heap_allocator heap;
+            return heap;
+        }
+    };
+
+    // Huge page backing of an arena
+    enum class Huge_pages
+    {
+        none,           // normal pages
+        transparent,    // madvise(MADV_HUGEPAGE), the kernel backs the range with 2MB pages when it can
+        explicit_pages  // MAP_HUGETLB, needs pages reserved in /proc/sys/vm/nr_hugepages
+    };
+
+    // Arena in one reserved virtual range. Blocks are bump allocated and memory is committed
+    // (made read/write) in steps of commit_step bytes as the arena grows, so the tape sits in one
+    // contiguous, possibly huge page backed range: fewer page faults and TLB misses in the sweeps.
+    // Blocks are not returned one by one (List_array keeps them for reuse); clear() gives the
+    // physical pages back with madvise(MADV_DONTNEED) when release_on_clear is set, the range stays
+    // reserved and committed and refaults zero pages on use.
+    // Without mmap (non Linux) the arena falls back to the heap.
+    class Mmap_arena : public Block_allocator
+    {
+    private:
+        static constexpr size_t huge_page = size_t(1) << 21;
+        static constexpr size_t alignment = 64;
+
+        char*       my_base      = nullptr;
+        size_t      my_reserved  = 0;
+        size_t      my_committed = 0;
+        size_t      my_used      = 0;
+        size_t      my_commit_step;
+        Huge_pages  my_huge_pages;
+        bool        my_release_on_clear;
+
+        static size_t round_up(const size_t n, const size_t to) {return (n + to - 1) / to * to;}
+
+    public:
+        Mmap_arena(
+            const size_t reserve_bytes,
+            const Huge_pages huge_pages = Huge_pages::transparent,
+            const bool release_on_clear = true,
+            const size_t commit_step = size_t(1) << 25)
+            : my_commit_step(round_up(commit_step, huge_page)), my_huge_pages(huge_pages), my_release_on_clear(release_on_clear)
+        {
+#if ARENA_MMAP
+            my_reserved = round_up(reserve_bytes, huge_page);
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+            if (huge_pages == Huge_pages::explicit_pages) flags |= MAP_HUGETLB;
+
+            // over reserve by a huge page to align the base
+            void* range = mmap(nullptr, my_reserved + huge_page, PROT_NONE, flags, -1, 0);
+            if (range == MAP_FAILED) {std::__throw_runtime_error("Mmap_arena: mmap failed");}
+            char*  raw     = static_cast<char*>(range);
+            char*  aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(raw), huge_page));
+            if (aligned > raw) munmap(raw, aligned - raw);
+            const size_t tail = (raw + my_reserved + huge_page) - (aligned + my_reserved);
+            if (tail) munmap(aligned + my_reserved, tail);
+            my_base = aligned;
+
+#ifdef MADV_HUGEPAGE
+            if (huge_pages == Huge_pages::transparent) madvise(my_base, my_reserved, MADV_HUGEPAGE);
+#endif
+#else
+            (void)reserve_bytes;
+#endif
+        }
+
+        ~Mmap_arena()
+        {
+#if ARENA_MMAP
+            if (my_base) munmap(my_base, my_reserved);
+#endif
+        }
+
+        Mmap_arena(const Mmap_arena&) = delete;
+        Mmap_arena& operator=(const Mmap_arena&) = delete;
+
+        void* allocate(const size_t bytes) override
+        {
+#if ARENA_MMAP
+            const size_t size = round_up(bytes, alignment);
+            if (my_used + size > my_reserved) {std::__throw_runtime_error("Mmap_arena: reserved range exhausted");}
+
+            // commit the next steps
+            if (my_used + size > my_committed)
+            {
+                const size_t committed = std::min(round_up(my_used + size, my_commit_step), my_reserved);
+                if (mprotect(my_base + my_committed, committed - my_committed, PROT_READ | PROT_WRITE))
+                {
+                    std::__throw_runtime_error("Mmap_arena: mprotect failed");
+                }
+                my_committed = committed;
+            }
+
+            void* block = my_base + my_used;
+            my_used += size;
+            return block;
+#else
+            return ::operator new(bytes);
+#endif
+        }
+
+        // Only the last block is given back to the arena
+        void deallocate(void* block, const size_t bytes) override
+        {
+#if ARENA_MMAP
+            const size_t size = round_up(bytes, alignment);
+            if (static_cast<char*>(block) + size == my_base + my_used) my_used -= size;
+#else
+            ::operator delete(block);
+#endif
+        }
+
+        void clear() override
+        {
+#if ARENA_MMAP
+            if (my_release_on_clear && my_committed) madvise(my_base, my_committed, MADV_DONTNEED);
+#endif
+        }
+
+        // Sizes in bytes
+        size_t reserved()  const {return my_reserved;}
+        size_t committed() const {return my_committed;}
+        size_t used()      const {return my_used;}
+        Huge_pages huge_pages() const {return my_huge_pages;}
+    };
+
+    // Arena backed by a scratch file, for recordings bigger than memory (see Tape::set_memory_budget()).
+    // Blocks are bump allocated in a shared mapping of an unlinked file in 'directory', page aligned.
+    // A block sealed by its List_array is written to the file asynchronously (sync_file_range). Once the
+    // sealed blocks in memory exceed budget_bytes, the oldest wait for their write and are dropped from
+    // memory. Dropped blocks stay valid: they are read back from the file when touched, ahead of time in
+    // the reverse sweep (read_ahead()). The directory should be on disk, /tmp may be a tmpfs (memory).
+    // Writes fall back to msync() where sync_file_range() is not supported, a failed write throws. Blocks
+    // the kernel refuses to drop stay in memory and are counted in refused(), not in spilled().
+    // The budget covers the blocks of the arena only, not the memory of their users (e.g. the tape adjoints).
+    // Without mmap (non Linux) the arena falls back to the heap and the budget is ignored.
+    class Spill_arena : public Block_allocator
+    {
+    private:
+        static constexpr size_t page = 4096;
+
+        int         my_fd        = -1;
+        char*       my_base      = nullptr;
+        size_t      my_reserved  = 0;
+        size_t      my_file_size = 0;
+        size_t      my_used      = 0;
+        size_t      my_budget;
+        size_t      my_file_step;
+
+        // sealed blocks in memory, oldest first, and their bytes
+        std::deque<std::pair<char*, size_t>> my_sealed;
+        size_t      my_sealed_bytes = 0;
+        // bytes dropped from memory since construction, and bytes the kernel refused to drop
+        size_t      my_spilled      = 0;
+        size_t      my_refused      = 0;
+
+        static size_t round_up(const size_t n, const size_t to) {return (n + to - 1) / to * to;}
+
+#if ARENA_MMAP
+        // Writes the pages of [first, first + size) to the file, and waits for them if wait
+        void write_back(char* const first, const size_t size, const bool wait)
+        {
+            const unsigned flags = wait 
+                ? SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER 
+                : SYNC_FILE_RANGE_WRITE;
+            if (!sync_file_range(my_fd, first - my_base, size, flags)) return;
+            // not supported by the file system (or an error, which msync() reports again)
+            if (msync(first, size, wait ? MS_SYNC : MS_ASYNC))
+            {
+                std::__throw_runtime_error("Spill_arena: cannot write the scratch file");
+            }
+        }
+#endif
+
+    public:
+        Spill_arena(
+            const size_t reserve_bytes,
+            const size_t budget_bytes,
+            const std::string& directory = "/var/tmp",
+            const size_t file_step = size_t(1) << 26)
+            : my_budget(budget_bytes), my_file_step(round_up(file_step, page))
+        {
+#if ARENA_MMAP
+#ifdef O_TMPFILE
+            my_fd = open(directory.c_str(), O_TMPFILE | O_RDWR, 0600);
+#endif
+            // file systems without O_TMPFILE: named file, unlinked at once
+            if (my_fd < 0)
+            {
+                std::string name = directory + "/tape_spill_XXXXXX";
+                my_fd = mkstemp(&name[0]);
+                if (my_fd >= 0) unlink(name.c_str());
+            }
+            if (my_fd < 0) {std::__throw_runtime_error("Spill_arena: cannot create the scratch file");}
+
+            my_reserved = round_up(reserve_bytes, page);
+            void* range = mmap(nullptr, my_reserved, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, my_fd, 0);
+            if (range == MAP_FAILED) {close(my_fd); std::__throw_runtime_error("Spill_arena: mmap failed");}
+            my_base = static_cast<char*>(range);
+#else
+            (void)reserve_bytes; (void)directory;
+#endif
+        }
+
+        ~Spill_arena()
+        {
+#if ARENA_MMAP
+            if (my_base) munmap(my_base, my_reserved);
+            if (my_fd >= 0) close(my_fd);
+#endif
+        }
+
+        Spill_arena(const Spill_arena&) = delete;
+        Spill_arena& operator=(const Spill_arena&) = delete;
+
+        void* allocate(const size_t bytes) override
+        {
+#if ARENA_MMAP
+            const size_t size = round_up(bytes, page);
+            if (my_used + size > my_reserved) {std::__throw_runtime_error("Spill_arena: reserved range exhausted");}
+
+            // grow the file in steps, with disk space so that writes back cannot fail
+            if (my_used + size > my_file_size)
+            {
+                const size_t file_size = std::min(round_up(my_used + size, my_file_step), my_reserved);
+                if (posix_fallocate(my_fd, my_file_size, file_size - my_file_size))
+                {
+                    std::__throw_runtime_error("Spill_arena: no space left for the scratch file");
+                }
+                my_file_size = file_size;
+            }
+
+            void* block = my_base + my_used;
+            my_used += size;
+            return block;
+#else
+            return ::operator new(bytes);
+#endif
+        }
+
+        // Only the last block is given back to the arena
+        void deallocate(void* block, const size_t bytes) override
+        {
+#if ARENA_MMAP
+            const size_t size = round_up(bytes, page);
+            if (static_cast<char*>(block) + size == my_base + my_used) my_used -= size;
+#else
+            ::operator delete(block);
+#endif
+        }
+
+        // Drops all pages without writing them, the blocks refault as zero pages
+        void clear() override
+        {
+#if ARENA_MMAP
+            my_sealed.clear();
+            my_sealed_bytes = 0;
+            if (!my_file_size) return;
+            // the pages are rewritten before they are read, if they stay they only take memory
+            if (madvise(my_base, my_file_size, MADV_DONTNEED)) my_refused += my_file_size;
+            // without hole punching the file keeps its blocks, else they are allocated again
+            if (fallocate(my_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, my_file_size) == 0
+                && posix_fallocate(my_fd, 0, my_file_size))
+            {
+                std::__throw_runtime_error("Spill_arena: no space left for the scratch file");
+            }
+#endif
+        }
+
+        // Starts writing the block, drops the oldest sealed blocks over budget
+        void seal(void* block, const size_t bytes) override
+        {
+#if ARENA_MMAP
+            char* const  first = static_cast<char*>(block);
+            const size_t size  = round_up(bytes, page);
+            write_back(first, size, false);
+            my_sealed.emplace_back(first, size);
+            my_sealed_bytes += size;
+
+            while (my_sealed_bytes > my_budget)
+            {
+                const auto oldest = my_sealed.front();
+                const off_t offset = oldest.first - my_base;
+                my_sealed.pop_front();
+                my_sealed_bytes -= oldest.second;
+
+                write_back(oldest.first, oldest.second, true);
+                // unmapped from the process, then dropped from the page cache
+                if (madvise(oldest.first, oldest.second, MADV_DONTNEED)
+                    || posix_fadvise(my_fd, offset, oldest.second, POSIX_FADV_DONTNEED))
+                {
+                    my_refused += oldest.second;
+                    continue;
+                }
+                my_spilled += oldest.second;
+            }
+#else
+            (void)block; (void)bytes;
+#endif
+        }
+
+        // Asynchronous read of the block if it was dropped
+        void read_ahead(const void* block, const size_t bytes) override
+        {
+#if ARENA_MMAP
+            char* const first = const_cast<char*>(static_cast<const char*>(block));
+            // a hint, if refused the pages are read when touched
+            (void)madvise(first, round_up(bytes, page), MADV_WILLNEED);
+#else
+            (void)block; (void)bytes;
+#endif
+        }
+
+        // Sizes in bytes
+        size_t reserved()      const {return my_reserved;}
+        size_t used()          const {return my_used;}
+        size_t budget()        const {return my_budget;}
+        size_t sealed_bytes()  const {return my_sealed_bytes;}
+        size_t spilled()       const {return my_spilled;}
+        size_t refused()       const {return my_refused;}
+    };
+} // namespace containers
+
+#endif
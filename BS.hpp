@@ -6,6 +6,7 @@
 
 // user includes 
 #include "Gaussian.hpp"
+#include "Tdouble.hpp"
 // Constants 
 #define EPS 1.e-12
 
@@ -36,7 +37,7 @@ inline double Black_Scholes_Ivol(
     double l = 0.05;
     while (Black_scholes(spot, strike, l, mat) > prem) l /= 2;
     pu = Black_scholes(spot, strike, u, mat);
-    Black_scholes(spot, strike, l, mat);
+    pl = Black_scholes(spot, strike, l, mat);
 
     while (u - l > 1.e-12)
     {
@@ -57,4 +58,31 @@ inline double Black_Scholes_Ivol(
     return l + (prem - pl) / (pu - pl) * (u - l);
 }
 
+//  Implied vol of Tdoubles. The bisection runs on values and only the root is recorded, as one node
+//  with the partials of the implicit function Black_scholes(spot, strike, vol, mat) = prem:
+//  dvol/dprem = 1/vega, dvol/dx = -(dC/dx)/vega for x = spot, strike, mat.
+inline Tdouble Black_Scholes_Ivol(
+    const Tdouble& spot,
+    const Tdouble& strike,
+    const Tdouble& prem,
+    const Tdouble& mat)
+{
+    using namespace gaussian;
+    const double s = spot.get_value(), k = strike.get_value(), t = mat.get_value();
+    const double vol = Black_Scholes_Ivol(s, k, prem.get_value(), t);
+    if (vol == 0.0) return Tdouble(0.0);
+
+    const double sqrt_t = sqrt(t);
+    const double std    = vol * sqrt_t;
+    const double d1     = (log(s / k) + 0.5 * std * std) / std;
+    const double d2     = d1 - std;
+    const double vega   = s * normalDens(d1) * sqrt_t;
+    // far out of the money the price has no vol sensitivity left
+    if (vega == 0.0) return Tdouble(vol);
+
+    const Tdouble* leaves[4]   = {&spot, &strike, &prem, &mat};
+    const double   partials[4] = {-normalCdf(d1) / vega, normalCdf(d2) / vega, 1.0 / vega, -0.5 * vol / t};
+    return Tdouble::custom_node(vol, leaves, partials, 4);
+}
+
 #endif
@@ -3,30 +3,41 @@
 
 #include "cf_funcs.hpp"
 
+// Templated on the number type T of the model parameters (double or Tdouble). Strikes, maturities and
+// the integration variable om are passive doubles. With T = Tdouble the complex algebra is recorded
+// by Tcomplex (see Tcomplex.hpp).
 namespace Bates_cf
 {
-    std::complex<double> cfBates(std::complex<double> om, double S, double mat, double r, double q, double v0, double vT, double rho, double k, double sigma, double intens, double jump_mean, double jump_std)
+    template<typename T>
+    cf_complex<T> cfBates(std::complex<double> om, const T& S, double mat, const T& r, const T& q, const T& v0, const T& vT, const T& rho, const T& k, const T& sigma, const T& intens, const T& jump_mean, const T& jump_std)
     {
-        auto d = sqrt( pow(rho * sigma * 1i * om - k, 2.) + sigma * sigma * (1i * om + om * om));
-        auto g2 = (k - rho * sigma * 1i * om - d) / (k - rho * sigma * 1i * om + d);
-        auto cf1 = 1i * om * (log(S) + (r - q) * mat);
-        auto cf2 = vT * k / (sigma * sigma) * ((k - rho * sigma * 1i * om - d) * mat - 2. * log((1. - g2 * exp(-d * mat)) / (1. - g2)));
-        auto cf3 = v0 / (sigma * sigma) * (k - rho * sigma * 1i * om - d) * (1. - exp(-d * mat)) / (1. - g2 * exp(-d * mat));
-        auto cf4 = -intens * jump_mean * 1i * om * mat + intens * mat *(pow(1. + jump_mean, 1i * om) * exp(0.5 * jump_std * jump_std * 1i * om * (1i*om - 1.)) - 1.);
+        // common subexpressions, computed once
+        const cf_complex<T> rsio = rho * sigma * 1i * om;
+        const cf_complex<T> d = sqrt( pow(rsio - k, 2.) + sigma * sigma * (1i * om + om * om));
+        const cf_complex<T> kmd = k - rsio - d;
+        const cf_complex<T> g2 = kmd / (k - rsio + d);
+        const cf_complex<T> edm = exp(-d * mat);
+        const cf_complex<T> cf1 = 1i * om * (log(S) + (r - q) * mat);
+        const cf_complex<T> cf2 = vT * k / (sigma * sigma) * (kmd * mat - 2. * log((1. - g2 * edm) / (1. - g2)));
+        const cf_complex<T> cf3 = v0 / (sigma * sigma) * kmd * (1. - edm) / (1. - g2 * edm);
+        const cf_complex<T> cf4 = -intens * jump_mean * 1i * om * mat + intens * mat *(pow(1. + jump_mean, 1i * om) * exp(0.5 * jump_std * jump_std * 1i * om * (1i*om - 1.)) - 1.);
         return exp(cf1 + cf2 + cf3 + cf4);
     }
 
-    double P1(double om, double S, double X, double mat, double r, double q, double v0, double vT, double rho, double k, double sigma, double intens, double jump_mean, double jump_std)
+    template<typename T>
+    T P1(double om, const T& S, double X, double mat, const T& r, const T& q, const T& v0, const T& vT, const T& rho, const T& k, const T& sigma, const T& intens, const T& jump_mean, const T& jump_std)
     {
         return Re(exp(-1i * log(X) * om) * cfBates(om - 1i, S, mat, r, q, v0, vT, rho, k, sigma, intens, jump_mean, jump_std) / (1i * om * S * exp((r - q) * mat)));
     }
 
-    double P2(double om, double S, double X, double mat, double r, double q, double v0, double vT, double rho, double k, double sigma, double intens, double jump_mean, double jump_std)
+    template<typename T>
+    T P2(double om, const T& S, double X, double mat, const T& r, const T& q, const T& v0, const T& vT, const T& rho, const T& k, const T& sigma, const T& intens, const T& jump_mean, const T& jump_std)
     {
         return Re(exp(-1i * log(X) * om) * cfBates(om, S, mat, r, q, v0, vT, rho, k, sigma, intens, jump_mean, jump_std) / (1i * om));
     }
 
-    auto bind_args_P1(double S, double X, double mat, double r, double q, double v0, double vT, double rho, double k, double sigma, double intens, double jump_mean, double jump_std)
+    template<typename T>
+    auto bind_args_P1(const T& S, double X, double mat, const T& r, const T& q, const T& v0, const T& vT, const T& rho, const T& k, const T& sigma, const T& intens, const T& jump_mean, const T& jump_std)
     {
         return [=] (double om_)
         {
@@ -34,7 +45,8 @@ namespace Bates_cf
         };
     }
 
-    auto bind_args_P2(double S, double X, double mat, double r, double q, double v0, double vT, double rho, double k, double sigma, double intens, double jump_mean, double jump_std)
+    template<typename T>
+    auto bind_args_P2(const T& S, double X, double mat, const T& r, const T& q, const T& v0, const T& vT, const T& rho, const T& k, const T& sigma, const T& intens, const T& jump_mean, const T& jump_std)
     {
         return [=] (double om_)
         {
@@ -43,13 +55,14 @@ namespace Bates_cf
     }
 } // end of namespace
 
-double Batescf_call(double S, double X, double mat, double r, double q, double v0, double vT, double rho, double k, double sigma, double intens, double jump_mean, double jump_std)
+template<typename T>
+T Batescf_call(const T& S, double X, double mat, const T& r, const T& q, const T& v0, const T& vT, const T& rho, const T& k, const T& sigma, const T& intens, const T& jump_mean, const T& jump_std)
 {
     double from = 0., to = 200.;
     int steps = 400; // ?no clue?
-    auto vP1 = 0.5 + 1. / Pi * integral(Bates_cf::bind_args_P1(S, X, mat, r, q, v0, vT, rho, k, sigma, intens, jump_mean, jump_std), from, to, steps);
-    auto vP2 = 0.5 + 1. / Pi * integral(Bates_cf::bind_args_P2(S, X, mat, r, q, v0, vT, rho, k, sigma, intens, jump_mean, jump_std), from, to, steps);
+    const T vP1 = 0.5 + 1. / Pi * integral(Bates_cf::bind_args_P1(S, X, mat, r, q, v0, vT, rho, k, sigma, intens, jump_mean, jump_std), from, to, steps);
+    const T vP2 = 0.5 + 1. / Pi * integral(Bates_cf::bind_args_P2(S, X, mat, r, q, v0, vT, rho, k, sigma, intens, jump_mean, jump_std), from, to, steps);
     return exp(-q * mat) * S * vP1 - exp(-r * mat) * X * vP2;
 }
 
-#endif
\ No newline at end of file
+#endif
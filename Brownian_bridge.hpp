@@ -0,0 +1,130 @@
+#ifndef BROWNIAN_BRIDGE_HPP
+#define BROWNIAN_BRIDGE_HPP
+
+// STL includes
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+// user includes
+#include "RNG_base.hpp"
+
+namespace RNG
+{
+    // Brownian bridge construction over a timeline, as an RNG wrapping another one (e.g. Sobol):
+    // the first gaussian of a vector gives W(T) at the last time, the next ones the midpoints of the
+    // intervals in bisection order. The gaussians handed out are the increments of W over the steps
+    // divided by sqrt(dt), independent standard normals as the pricers of MC.hpp expect, so the leading
+    // dimensions of a low discrepancy generator drive the largest part of the path variance.
+    // times are the simulation times without 0 (surface.mats), ascending or descending as in the pricers.
+    // Steps of length 0 get gaussian 0. nextU() hands out the uniforms of the wrapped RNG unchanged.
+    class Brownian_bridge : public RNG_base
+    {
+    private:
+        RNG_base&           my_rng;
+        std::vector<double> my_times;
+        // point built by the i'th gaussian, its left (0 for time 0, else left point + 1) and right points
+        std::vector<size_t> my_bridge, my_left, my_right;
+        std::vector<double> my_left_weights, my_right_weights, my_std_devs;
+        // 1 / sqrt(dt) of each step, 0 for steps of length 0
+        std::vector<double> my_inv_sqrt_dts;
+        std::vector<double> my_path;
+
+    public:
+        Brownian_bridge(RNG_base& rng, std::vector<double> times) : my_rng(rng), my_times(times)
+        {
+            if (my_times.size() > 1 && my_times[0] > my_times[1]) std::reverse(my_times.begin(), my_times.end());
+            const size_t n = my_times.size();
+            if (!n) std::__throw_runtime_error("Brownian_bridge: no times");
+            const std::vector<double>& t = my_times;
+
+            my_bridge.resize(n);
+            my_left.resize(n);
+            my_right.resize(n);
+            my_left_weights.assign(n, 0.);
+            my_right_weights.assign(n, 0.);
+            my_std_devs.assign(n, 0.);
+            my_path.resize(n);
+
+            // points already built
+            std::vector<bool> built(n, false);
+            built[n - 1] = true;
+            my_bridge[0]   = n - 1;
+            my_std_devs[0] = sqrt(t[n - 1]);
+
+            for (size_t i = 1, j = 0; i < n; ++i)
+            {
+                // next interval of points to build [j, k), bisected at l
+                while (built[j]) ++j;
+                size_t k = j;
+                while (!built[k]) ++k;
+                const size_t l = j + ((k - 1 - j) >> 1);
+                built[l] = true;
+
+                my_bridge[i] = l;
+                my_left[i]   = j;
+                my_right[i]  = k;
+
+                const double t_left = j ? t[j - 1] : 0.;
+                const double span   = t[k] - t_left;
+                if (span > 0)
+                {
+                    my_left_weights[i]  = (t[k] - t[l]) / span;
+                    my_right_weights[i] = (t[l] - t_left) / span;
+                    my_std_devs[i]      = sqrt((t[l] - t_left) * (t[k] - t[l]) / span);
+                }
+                else my_left_weights[i] = 1.;
+
+                j = k + 1;
+                if (j >= n) j = 0;
+            }
+
+            my_inv_sqrt_dts.resize(n);
+            for (size_t j = 0; j < n; ++j)
+            {
+                const double dt = t[j] - (j ? t[j - 1] : 0.);
+                my_inv_sqrt_dts[j] = dt > 0 ? 1. / sqrt(dt) : 0.;
+            }
+        }
+
+        // gaussians z of the bridge in place to the gaussians of the steps
+        void transform(double* z)
+        {
+            double* w = my_path.data();
+            const size_t n = my_times.size();
+            w[n - 1] = my_std_devs[0] * z[0];
+            for (size_t i = 1; i < n; ++i)
+            {
+                const size_t j = my_left[i];
+                w[my_bridge[i]] = (j ? my_left_weights[i] * w[j - 1] : 0.) + my_right_weights[i] * w[my_right[i]]
+                    + my_std_devs[i] * z[i];
+            }
+            z[0] = w[0] * my_inv_sqrt_dts[0];
+            for (size_t j = 1; j < n; ++j) z[j] = (w[j] - w[j - 1]) * my_inv_sqrt_dts[j];
+        }
+
+        void init(const size_t simDim) override
+        {
+            if (simDim != my_times.size()) std::__throw_runtime_error("Brownian_bridge: dimension is not the number of times");
+            my_rng.init(simDim);
+        }
+
+        void reset_members() override {my_rng.reset_members();}
+
+        void nextU(std::vector<double>& uVec) override {my_rng.nextU(uVec);}
+        void nextU_block(double* uniforms, const size_t n) override {my_rng.nextU_block(uniforms, n);}
+
+        void nextG(std::vector<double>& gVec) override
+        {
+            nextG_block(gVec.data(), 1);
+        }
+
+        void nextG_block(double* gaussians, const size_t n) override
+        {
+            my_rng.nextG_block(gaussians, n);
+            for (size_t i = 0; i < n; ++i) transform(gaussians + i * my_times.size());
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+// STL includes
+#include <array>
+#include <vector>
+#include <algorithm>
+
+// user includes
+#include "Tdouble.hpp"
+
+// Binomial (revolve) checkpointing of a time-step loop recorded with Tdouble.
+// The loop advances a path state of N Tdoubles, state_{j+1} = step(state_j, j), for j = 0..n_steps-1.
+// Instead of recording the whole loop, only the state values at a few steps (snapshots) are stored.
+// The reverse sweep re-records one segment of steps at a time from its snapshot, on a nested mark
+// (Tdouble::push_mark()), and carries the state adjoints backwards from segment to segment.
+// Nodes recorded before the loop (surface, inputs) keep their adjoints, as with propagate_to_mark().
+//
+// The budget bounds the tape: at most tape_nodes nodes are recorded above the mark at once (estimated
+// from the first step), and at most snapshots path states are stored besides the initial one. With
+// s snapshots and L segments the steps are recorded t + 1 times, t the smallest with C(s + t, s) >= L.
+struct Checkpoint_budget
+{
+    size_t snapshots  = 8;
+    size_t tape_nodes = 1 << 16;
+};
+
+template<size_t N, typename Step>
+class Checkpointed_loop
+{
+private:
+    using state_t  = std::array<Tdouble, N>;
+    using values_t = std::array<double, N>;
+
+    Step&   my_step;
+    size_t  my_n_steps;
+    size_t  my_segment;     // steps per segment
+    size_t  my_output;      // index of the output in the state
+    // adjoints of the state at the current position of the reverse sweep
+    values_t my_adjoints;
+    // value of the output at the end of the loop
+    double   my_result  = 0;
+
+    // Leaves on tape holding the state values
+    static state_t leaves(const values_t& x)
+    {
+        state_t state;
+        for (size_t k = 0; k < N; ++k) {state[k] = x[k]; state[k].put_on_tape();}
+        return state;
+    }
+
+    // Advances the state values over steps [from, to), rewinding the tape after every step
+    void advance(values_t& x, const size_t from, const size_t to)
+    {
+        for (size_t j = from; j < to; ++j)
+        {
+            state_t state = leaves(x);
+            my_step(state, j);
+            for (size_t k = 0; k < N; ++k) x[k] = state[k].get_value();
+            Tdouble::set_to_top_mark();
+        }
+    }
+
+    // Records steps [from, to) from the state values x and propagates the state adjoints through them
+    void reverse(const values_t& x, const size_t from, const size_t to)
+    {
+        state_t start = leaves(x);
+        state_t state = start;
+        for (size_t j = from; j < to; ++j) my_step(state, j);
+        if (to == my_n_steps) my_result = state[my_output].get_value();
+
+        for (size_t k = 0; k < N; ++k) state[k].get_adjoint() += my_adjoints[k];
+        Tdouble::propagate_to_top_mark();
+
+        for (size_t k = 0; k < N; ++k) my_adjoints[k] = start[k].get_adjoint();
+        Tdouble::set_to_top_mark();
+    }
+
+    // C(s + t, s), the number of segments reversible with s snapshots and t + 1 recordings
+    static size_t beta(const size_t s, const size_t t)
+    {
+        size_t b = 1;
+        for (size_t i = 1; i <= s; ++i) b = b * (t + i) / i;
+        return b;
+    }
+
+    // Reverses segments [a, b) from the state values at segment a with s free snapshots
+    void revolve(const values_t& x_a, const size_t a, const size_t b, const size_t s)
+    {
+        const size_t L = b - a;
+        if (L == 1)
+        {
+            reverse(x_a, a * my_segment, std::min(b * my_segment, my_n_steps));
+        }
+        else if (s == 0)
+        {
+            for (size_t i = b; i-- > a;)
+            {
+                values_t x = x_a;
+                advance(x, a * my_segment, i * my_segment);
+                reverse(x, i * my_segment, std::min((i + 1) * my_segment, my_n_steps));
+            }
+        }
+        else
+        {
+            size_t t = 0;
+            while (beta(s, t) < L) ++t;
+            const size_t head = std::min(beta(s, t - 1), L - 1);
+
+            values_t x_m = x_a;
+            advance(x_m, a * my_segment, (a + head) * my_segment);
+            revolve(x_m, a + head, b, s - 1);
+            revolve(x_a, a, a + head, s);
+        }
+    }
+
+public:
+    Checkpointed_loop(Step& step_, const size_t n_steps_) : my_step(step_), my_n_steps(n_steps_) {}
+
+    // Runs the loop from state0 and propagates state[output] at the end back to state0, whose
+    // nodes receive the adjoints. Returns the value of state[output] at the end.
+    // state0 must not be recorded after the top mark, i.e. it holds inputs, copies or passive values.
+    double run(state_t& state0, const size_t output, const Checkpoint_budget& budget)
+    {
+        values_t x0;
+        for (size_t k = 0; k < N; ++k) x0[k] = state0[k].get_value();
+        if (!my_n_steps) return x0[output];
+
+        Tdouble::push_mark();
+
+        // Nodes per step, measured on the first step, gives the steps per segment
+        const size_t mark = Tdouble::tape->nodes();
+        {
+            state_t state = leaves(x0);
+            my_step(state, 0);
+        }
+        const size_t step_nodes = std::max<size_t>(Tdouble::tape->nodes() - mark, 1);
+        Tdouble::set_to_top_mark();
+        my_segment = std::max<size_t>(budget.tape_nodes / step_nodes, 1);
+        const size_t segments = (my_n_steps + my_segment - 1) / my_segment;
+
+        // the reverse of the last segment records the end of the loop, and the output value
+        my_output = output;
+        my_adjoints.fill(0.);
+        my_adjoints[output] = 1.;
+        revolve(x0, 0, segments, budget.snapshots);
+
+        Tdouble::pop_mark();
+        for (size_t k = 0; k < N; ++k) state0[k].get_adjoint() += my_adjoints[k];
+
+        return my_result;
+    }
+};
+
+// Runs step(state, j) for j = 0..n_steps-1 with binomial checkpointing and propagates state[output]
+template<size_t N, typename Step>
+double checkpointed_loop(
+    std::array<Tdouble, N>& state0,
+    const size_t n_steps,
+    Step step,
+    const size_t output,
+    const Checkpoint_budget& budget)
+{
+    Checkpointed_loop<N, Step> loop(step, n_steps);
+    return loop.run(state0, output, budget);
+}
+
+// Local Jacobian preaccumulation.
+// Records f(), returning K Tdoubles that depend on the tape only through inputs, on a nested mark
+// (Tdouble::push_mark()), and propagates the K outputs to the inputs in one vector mode sweep.
+// The subgraph of f is then rewound and every output recorded above the mark is recorded again as a
+// single custom node (see Tdouble::custom_node()) with its Jacobian row on the inputs. The tape keeps
+// K nodes for f however large its subgraph, e.g. the implied and local vol of a surface cell as
+// functions of the model parameters (see Surface_point() in Surface.hpp).
+// Sets the tape to K lanes.
+template<size_t K, typename F>
+std::array<Tdouble, K> preaccumulate(const std::vector<const Tdouble*>& inputs, F f)
+{
+    Tape& tape = *Tdouble::tape;
+    const size_t n = inputs.size();
+
+    Tdouble::push_mark();
+    const size_t mark = tape.nodes();
+    std::array<Tdouble, K> outputs = f();
+
+    // Jacobian rows of the outputs recorded above the mark
+    std::array<bool, K> local;
+    bool   active = false;
+    size_t from   = mark;
+    if (tape.lanes() != K) tape.set_lanes(K);
+    for (size_t k = 0; k < K; ++k)
+    {
+        local[k] = outputs[k].is_active() && outputs[k].get_index() >= mark;
+        if (!local[k]) continue;
+        outputs[k].get_adjoint(k) = 1;
+        from   = std::max<size_t>(from, outputs[k].get_index());
+        active = true;
+    }
+    if (active) tape.propagate_lanes<K>(from, mark);
+
+    std::vector<double> jacobian(K * n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (size_t k = 0; k < K; ++k)
+        {
+            jacobian[k * n + i] = inputs[i]->get_adjoint(k);
+            inputs[i]->get_adjoint(k) = 0;
+        }
+    }
+
+    Tdouble::set_to_top_mark();
+    Tdouble::pop_mark();
+
+    for (size_t k = 0; k < K; ++k)
+    {
+        if (local[k]) outputs[k] = Tdouble::custom_node(outputs[k].get_value(), inputs.data(), &jacobian[k * n], n);
+    }
+    return outputs;
+}
+
+#endif
@@ -0,0 +1,291 @@
+#ifndef DUAL_HPP
+#define DUAL_HPP
+
+// STL includes
+#include <math.h>
+#include <array>
+
+// user includes
+#include "Gaussian.hpp"
+#include "Tdouble.hpp"
+
+// Forward mode dual number. Carries a value and a tangent (directional derivative) through templated code
+// such as Black_scholes, smoother, interp and payoffs::europeans::Call_standard.
+//
+// T is the number type of value and tangent. With T = double a run gives f and the directional derivative
+// df.v for a tangent direction v set on the inputs. With T = Tdouble (see Tdouble.hpp) the run is recorded
+// on tape: propagating the tangent of the result gives the Hessian-vector product H.v on the inputs'
+// adjoints, and propagating the value gives the gradient (both in one sweep using the vector mode, K = 2).
+// E.g. gamma and vanna of Black_scholes:
+//      Tdouble s = 100., vol = 0.2; s.put_on_tape(); vol.put_on_tape();
+//      Dual<Tdouble> S(s, 1.0), V(vol, 0.0);           // direction: spot
+//      Dual<Tdouble> price = Black_scholes<Dual<Tdouble>>(S, 110., V, 3.);
+//      price.tangent().propagate_to_start();          // s.get_adjoint() = gamma, vol.get_adjoint() = vanna
+// hessian_vector() below does this for a function of N inputs. MC_European_CallOption_Gamma_AAD in MC.hpp
+// runs the local vol MC on Dual<Tdouble>: gamma and the cross gammas to the local vols in one run, but
+// recording every operation of the path it costs 3-4x a central bump of the fused AAD pricer.
+template<typename T = double>
+class Dual
+{
+private:
+    T my_value;
+    T my_tangent;
+
+public:
+    // CTORS
+    Dual() {}
+    Dual(const double value_) : my_value(value_), my_tangent(0.0) {}
+    Dual(const T& value_, const T& tangent_) : my_value(value_), my_tangent(tangent_) {}
+
+    // Getters
+    T&       value()         {return my_value;}
+    const T& value()   const {return my_value;}
+    T&       tangent()       {return my_tangent;}
+    const T& tangent() const {return my_tangent;}
+
+    // Explicit conversion to double
+    explicit operator double() const {return double(my_value);}
+
+// ---------------------------------------------------------------
+// - BOOLS (on values)
+// ---------------------------------------------------------------
+    inline friend bool operator< (const Dual& l_arg, const Dual& r_arg) {return l_arg.my_value <  r_arg.my_value;}
+    inline friend bool operator> (const Dual& l_arg, const Dual& r_arg) {return l_arg.my_value >  r_arg.my_value;}
+    inline friend bool operator<=(const Dual& l_arg, const Dual& r_arg) {return l_arg.my_value <= r_arg.my_value;}
+    inline friend bool operator>=(const Dual& l_arg, const Dual& r_arg) {return l_arg.my_value >= r_arg.my_value;}
+    inline friend bool operator==(const Dual& l_arg, const Dual& r_arg) {return l_arg.my_value == r_arg.my_value;}
+    inline friend bool operator!=(const Dual& l_arg, const Dual& r_arg) {return l_arg.my_value != r_arg.my_value;}
+
+    inline friend bool operator< (const Dual& l_arg, const double r_arg) {return l_arg.my_value <  r_arg;}
+    inline friend bool operator> (const Dual& l_arg, const double r_arg) {return l_arg.my_value >  r_arg;}
+    inline friend bool operator<=(const Dual& l_arg, const double r_arg) {return l_arg.my_value <= r_arg;}
+    inline friend bool operator>=(const Dual& l_arg, const double r_arg) {return l_arg.my_value >= r_arg;}
+    inline friend bool operator< (const double l_arg, const Dual& r_arg) {return l_arg <  r_arg.my_value;}
+    inline friend bool operator> (const double l_arg, const Dual& r_arg) {return l_arg >  r_arg.my_value;}
+    inline friend bool operator<=(const double l_arg, const Dual& r_arg) {return l_arg <= r_arg.my_value;}
+    inline friend bool operator>=(const double l_arg, const Dual& r_arg) {return l_arg >= r_arg.my_value;}
+
+// ---------------------------------------------------------------
+// - BINARY OPERATORS
+// ---------------------------------------------------------------
+    inline friend Dual operator+(const Dual& l_arg, const Dual& r_arg)
+    {
+        return Dual(l_arg.my_value + r_arg.my_value, l_arg.my_tangent + r_arg.my_tangent);
+    }
+
+    inline friend Dual operator+(const Dual& l_arg, const double r_arg)
+    {
+        return Dual(l_arg.my_value + r_arg, l_arg.my_tangent);
+    }
+
+    inline friend Dual operator+(const double l_arg, const Dual& r_arg)
+    {
+        return r_arg + l_arg;
+    }
+
+    inline friend Dual operator-(const Dual& l_arg, const Dual& r_arg)
+    {
+        return Dual(l_arg.my_value - r_arg.my_value, l_arg.my_tangent - r_arg.my_tangent);
+    }
+
+    inline friend Dual operator-(const Dual& l_arg, const double r_arg)
+    {
+        return Dual(l_arg.my_value - r_arg, l_arg.my_tangent);
+    }
+
+    inline friend Dual operator-(const double l_arg, const Dual& r_arg)
+    {
+        return Dual(l_arg - r_arg.my_value, -r_arg.my_tangent);
+    }
+
+    inline friend Dual operator*(const Dual& l_arg, const Dual& r_arg)
+    {
+        return Dual(l_arg.my_value * r_arg.my_value,
+            l_arg.my_tangent * r_arg.my_value + l_arg.my_value * r_arg.my_tangent);
+    }
+
+    inline friend Dual operator*(const Dual& l_arg, const double r_arg)
+    {
+        return Dual(l_arg.my_value * r_arg, l_arg.my_tangent * r_arg);
+    }
+
+    inline friend Dual operator*(const double l_arg, const Dual& r_arg)
+    {
+        return r_arg * l_arg;
+    }
+
+    inline friend Dual operator/(const Dual& l_arg, const Dual& r_arg)
+    {
+        const T val = l_arg.my_value / r_arg.my_value;
+        return Dual(val, (l_arg.my_tangent - val * r_arg.my_tangent) / r_arg.my_value);
+    }
+
+    inline friend Dual operator/(const Dual& l_arg, const double r_arg)
+    {
+        return Dual(l_arg.my_value / r_arg, l_arg.my_tangent / r_arg);
+    }
+
+    inline friend Dual operator/(const double l_arg, const Dual& r_arg)
+    {
+        const T val = l_arg / r_arg.my_value;
+        return Dual(val, -val * r_arg.my_tangent / r_arg.my_value);
+    }
+
+    // max, min: tangent of the selected argument
+    inline friend Dual max(const Dual& l_arg, const Dual& r_arg) {return l_arg > r_arg ? l_arg : r_arg;}
+    inline friend Dual max(const Dual& l_arg, const double r_arg) {return l_arg > r_arg ? l_arg : Dual(r_arg);}
+    inline friend Dual max(const double l_arg, const Dual& r_arg) {return l_arg > r_arg ? Dual(l_arg) : r_arg;}
+    inline friend Dual min(const Dual& l_arg, const Dual& r_arg) {return l_arg < r_arg ? l_arg : r_arg;}
+    inline friend Dual min(const Dual& l_arg, const double r_arg) {return l_arg < r_arg ? l_arg : Dual(r_arg);}
+    inline friend Dual min(const double l_arg, const Dual& r_arg) {return l_arg < r_arg ? Dual(l_arg) : r_arg;}
+
+    // pow
+    inline friend Dual pow(const Dual& l_arg, const double r_arg)
+    {
+        const T val = pow(l_arg.my_value, r_arg);
+        return Dual(val, r_arg * pow(l_arg.my_value, r_arg - 1.0) * l_arg.my_tangent);
+    }
+
+    inline friend Dual pow(const Dual& l_arg, const Dual& r_arg)
+    {
+        return exp(r_arg * log(l_arg));
+    }
+
+    inline friend Dual pow(const double l_arg, const Dual& r_arg)
+    {
+        const T val = pow(l_arg, r_arg.my_value);
+        return Dual(val, log(l_arg) * val * r_arg.my_tangent);
+    }
+
+// ---------------------------------------------------------------
+// - UNARY OPERATORS
+// ---------------------------------------------------------------
+    Dual operator-() const {return Dual(-my_value, -my_tangent);}
+    Dual operator+() const {return *this;}
+
+    // +=, -=, *=, /=
+    Dual& operator+=(const Dual& arg)   {*this = *this + arg; return *this;}
+    Dual& operator+=(const double arg)  {*this = *this + arg; return *this;}
+    Dual& operator-=(const Dual& arg)   {*this = *this - arg; return *this;}
+    Dual& operator-=(const double arg)  {*this = *this - arg; return *this;}
+    Dual& operator*=(const Dual& arg)   {*this = *this * arg; return *this;}
+    Dual& operator*=(const double arg)  {*this = *this * arg; return *this;}
+    Dual& operator/=(const Dual& arg)   {*this = *this / arg; return *this;}
+    Dual& operator/=(const double arg)  {*this = *this / arg; return *this;}
+
+    // sqrt
+    inline friend Dual sqrt(const Dual& arg)
+    {
+        const T val = sqrt(arg.my_value);
+        return Dual(val, 0.5 * arg.my_tangent / val);
+    }
+
+    // exp
+    inline friend Dual exp(const Dual& arg)
+    {
+        const T val = exp(arg.my_value);
+        return Dual(val, val * arg.my_tangent);
+    }
+
+    // log
+    inline friend Dual log(const Dual& arg)
+    {
+        return Dual(log(arg.my_value), arg.my_tangent / arg.my_value);
+    }
+
+    // abs
+    inline friend Dual abs(const Dual& arg)
+    {
+        return arg.my_value > 0 ? arg : -arg;
+    }
+
+    inline friend Dual fabs(const Dual& arg)
+    {
+        return abs(arg);
+    }
+
+    inline friend Dual sin(const Dual& arg)
+    {
+        return Dual(sin(arg.my_value), cos(arg.my_value) * arg.my_tangent);
+    }
+
+    inline friend Dual cos(const Dual& arg)
+    {
+        return Dual(cos(arg.my_value), -sin(arg.my_value) * arg.my_tangent);
+    }
+
+    // utilized gaussians.hpp normalCdf
+    inline friend Dual normalCdf(const Dual& arg)
+    {
+        using gaussian::normalCdf;
+        using gaussian::normalDens;
+        return Dual(normalCdf(arg.my_value), normalDens(arg.my_value) * arg.my_tangent);
+    }
+
+    // utilized gaussians.hpp normalDens
+    inline friend Dual normalDens(const Dual& arg)
+    {
+        using gaussian::normalDens;
+        const T val = normalDens(arg.my_value);
+        return Dual(val, -val * arg.my_value * arg.my_tangent);
+    }
+};
+
+// ---------------------------------------------------------------
+// - SECOND ORDER DRIVER
+// ---------------------------------------------------------------
+// Value, gradient and Hessian-vector product H.v of f at x
+template<size_t N>
+struct Second_order
+{
+    double value;
+    std::array<double, N> gradient, hessian_v;
+};
+
+// Forward over reverse: f (templated on its number type, e.g. a generic lambda calling Black_scholes) is
+// recorded once on Dual<Tdouble> inputs x with tangents v, and one vector mode sweep seeded with the value
+// (lane 0) and the tangent (lane 1) of the result gives the gradient and H.v.
+// Recorded on a nested mark and rewound as preaccumulate() in Checkpoint.hpp. Sets the tape to 2 lanes.
+template<size_t N, typename F>
+Second_order<N> hessian_vector(F f, const std::array<double, N>& x, const std::array<double, N>& v)
+{
+    Tape& tape = *Tdouble::tape;
+    Tdouble::push_mark();
+    const size_t mark = tape.nodes();
+
+    std::array<Tdouble, N> inputs;
+    std::array<Dual<Tdouble>, N> duals;
+    for (size_t i = 0; i < N; ++i)
+    {
+        inputs[i] = x[i];
+        inputs[i].put_on_tape();
+        duals[i] = Dual<Tdouble>(inputs[i], Tdouble(v[i]));
+    }
+    const Dual<Tdouble> res = f(duals);
+
+    Second_order<N> out;
+    out.value = res.value().get_value();
+    Tdouble::set_lanes(2);
+    const Tdouble* outputs[2] = {&res.value(), &res.tangent()};
+    bool   active = false;
+    size_t from   = 0;
+    for (size_t k = 0; k < 2; ++k)
+    {
+        if (!outputs[k]->is_active()) continue;
+        outputs[k]->get_adjoint(k) = 1;
+        from   = std::max<size_t>(from, outputs[k]->get_index());
+        active = true;
+    }
+    if (active) tape.propagate_lanes<2>(from, mark);
+    for (size_t i = 0; i < N; ++i)
+    {
+        out.gradient[i]  = inputs[i].get_adjoint(0);
+        out.hessian_v[i] = inputs[i].get_adjoint(1);
+    }
+
+    Tdouble::set_to_top_mark();
+    Tdouble::pop_mark();
+    return out;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef FUSED_HPP
+#define FUSED_HPP
+
+// STL includes
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+// user includes
+#include "Tdouble.hpp"
+#include "interp.hpp"
+
+// Fused primitives for the hot loops of the AAD pricers in MC.hpp. Each records a single custom node
+// (see Tdouble::custom_node()) with partials computed by hand from double values, instead of an
+// expression with intermediate Tdoubles. Values are computed in the same order as the generic code.
+
+// ---------------------------------------------------------------
+// - INTERPOLATION
+// ---------------------------------------------------------------
+// Linear interpolation in a row of Tdoubles (a local vol surface row), flat outside the grid.
+// One node with children y1, y2 and x0, or a copy of the end point outside the grid.
+template <class ITX, class ITY>
+inline auto interp(
+    ITX                         xBegin,
+    ITX                         xEnd,
+    ITY                         yBegin,
+    ITY                         yEnd,
+    const Tdouble&              x0)
+    -> std::enable_if_t<std::is_same<std::decay_t<decltype(*yBegin)>, Tdouble>::value, Tdouble>
+{
+    const double x = x0.get_value();
+    auto it = std::upper_bound(xBegin, xEnd, x);
+
+    if (it == xEnd) return *(yEnd - 1);
+    if (it == xBegin) return *yBegin;
+
+    const size_t n = std::distance(xBegin, it) - 1;
+    const double x1 = xBegin[n];
+    const double x2 = xBegin[n + 1];
+    const Tdouble& y1 = yBegin[n];
+    const Tdouble& y2 = yBegin[n + 1];
+
+    const double t  = (x - x1) / (x2 - x1);
+    const double dy = y2.get_value() - y1.get_value();
+
+    const Tdouble* leaves[3]   = {&y1, &y2, &x0};
+    const double   partials[3] = {1. - t, t, dy / (x2 - x1)};
+    return Tdouble::custom_node(y1.get_value() + dy * t, leaves, partials, 3);
+}
+
+// ---------------------------------------------------------------
+// - SMOOTHER
+// ---------------------------------------------------------------
+// fIf of Products.hpp on tape: x_neg + (x_pos - x_neg) / eps * clamp(x + eps/2, 0, eps).
+// One node with children x, x_pos and x_neg, x only inside the smoothing band.
+inline Tdouble fIf(const Tdouble& x, const Tdouble& x_pos, const Tdouble& x_neg, const double eps)
+{
+    const double a = x.get_value() + eps / 2.;
+    const double c = std::max(0.0, std::min(eps, a));
+    const double pos = x_pos.get_value(), neg = x_neg.get_value();
+
+    const Tdouble* leaves[3]   = {&x, &x_pos, &x_neg};
+    const double   partials[3] = {0. < a && a < eps ? (pos - neg) / eps : 0., c / eps, 1. - c / eps};
+    return Tdouble::custom_node(neg + (pos - neg) / eps * c, leaves, partials, 3);
+}
+
+// ---------------------------------------------------------------
+// - LOCAL VOL STEP
+// ---------------------------------------------------------------
+// Log-Euler step of the local vol dynamics over dt with the gaussian z:
+//      vol   = interp(spots, row, spot)
+//      spot' = spot * exp((mu - 0.5 * vol * vol) * dt + vol * sqrt(dt) * z)
+// One node with children spot, mu and the (at most two) surface nodes of the interpolation.
+// The spot partial includes the dependence of vol on spot.
+inline Tdouble local_vol_step(
+    const std::vector<double>&  spots,
+    const Tdouble*              row,
+    const Tdouble&              spot,
+    const Tdouble&              mu,
+    const double                dt,
+    const double                z)
+{
+    const double s = spot.get_value();
+    auto it = std::upper_bound(spots.begin(), spots.end(), s);
+
+    // interpolation: vol = y1 + (y2 - y1) * t, flat outside the grid
+    const bool inside = it != spots.begin() && it != spots.end();
+    const size_t n = it == spots.end() ? spots.size() - 1 : inside ? std::distance(spots.begin(), it) - 1 : 0;
+    double t = 0., vol = row[n].get_value(), dvol_ds = 0.;
+    if (inside)
+    {
+        const double dx = spots[n + 1] - spots[n];
+        const double dy = row[n + 1].get_value() - row[n].get_value();
+        t       = (s - spots[n]) / dx;
+        vol     = vol + dy * t;
+        dvol_ds = dy / dx;
+    }
+
+    const double growth = exp((mu.get_value() - 0.5 * vol * vol) * dt + vol * sqrt(dt) * z);
+    const double value  = s * growth;
+    // d spot' / d vol
+    const double dvol   = value * (sqrt(dt) * z - vol * dt);
+
+    const Tdouble* leaves[4]   = {&spot, &mu, &row[n], &row[inside ? n + 1 : n]};
+    const double   partials[4] = {growth + dvol * dvol_ds, value * dt, dvol * (1. - t), dvol * t};
+    return Tdouble::custom_node(value, leaves, partials, 4);
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define GAUSSIAN_HPP
 
 #include <math.h>
+#include <cstddef>
 
 namespace gaussian
 {
@@ -40,11 +41,8 @@ namespace gaussian
     //  Beasley-Springer-Moro algorithm
     //  Moro, The full Monte, Risk, 1995
     //  See Glasserman, Monte Carlo Methods in Financial Engineering, p 68
-    inline double invNormalCdf(const double p)
+    namespace moro
     {
-        const bool sup = p > 0.5;
-        const double up = sup ? 1.0 - p : p;
-
         static constexpr double a0 = 2.50662823884;
         static constexpr double a1 = -18.61500062529;
         static constexpr double a2 = 41.39119773534;
@@ -65,22 +63,72 @@ namespace gaussian
         static constexpr double c7 = 0.0000002888167364;
         static constexpr double c8 = 0.0000003960315187;
 
-        double x = up - 0.5;
-        double r;
+        // rational approximation for |x| < 0.42, x = up - 0.5
+        inline double central(const double x)
+        {
+            const double r = x*x;
+            return x*(((a3*r + a2)*r + a1)*r + a0) / ((((b3*r + b2)*r + b1)*r + b0)*r + 1.0);
+        }
+
+        // Chebyshev polynomial in log(-log(up)) for the tails
+        inline double tail(const double up)
+        {
+            const double r = log(-log(up));
+            return c0 + r*(c1 + r*(c2 + r*(c3 + r*(c4 + r*(c5 + r*(c6 + r*(c7 + r*c8)))))));
+        }
+    }
+
+    inline double invNormalCdf(const double p)
+    {
+        const bool sup = p > 0.5;
+        const double up = sup ? 1.0 - p : p;
+        const double x = up - 0.5;
 
         if (fabs(x)<0.42)
         {
-            r = x*x;
-            r = x*(((a3*r + a2)*r + a1)*r + a0) / ((((b3*r + b2)*r + b1)*r + b0)*r + 1.0);
+            const double r = moro::central(x);
             return sup ? -r: r;
         }
 
-        r = up;
-        r = log(-log(r));
-        r = c0 + r*(c1 + r*(c2 + r*(c3 + r*(c4 + r*(c5 + r*(c6 + r*(c7 + r*c8)))))));
-
+        const double r = moro::tail(up);
         return sup? r: -r;
     }
+
+    //  invNormalCdf of n uniforms p into res (p == res allowed), the same numbers as the scalar version.
+    //  Blocks of 64 draws: the central approximation runs branch-free over the whole block (vectorisable,
+    //  a fixed trip count and no selects), the draws in the tails (about 16%) are listed without branches
+    //  and patched after.
+    inline void invNormalCdf(const double* p, double* res, const size_t n)
+    {
+        constexpr size_t block = 64;
+        double ups[block], signs[block], central[block];
+        size_t tails[block];
+
+        for (size_t first = 0; first < n; first += block)
+        {
+            const size_t size = n - first < block ? n - first : block;
+            for (size_t i = 0; i < size; ++i) ups[i] = p[first + i];
+            for (size_t i = size; i < block; ++i) ups[i] = 0.5;
+
+            // up = min(p, 1 - p), sign -1 above 0.5
+            for (size_t i = 0; i < block; ++i)
+            {
+                signs[i] = copysign(1.0, 0.5 - ups[i]);
+                ups[i]   = 1.0 - ups[i] < ups[i] ? 1.0 - ups[i] : ups[i];
+            }
+            for (size_t i = 0; i < block; ++i) central[i] = signs[i] * moro::central(ups[i] - 0.5);
+
+            size_t n_tails = 0;
+            for (size_t i = 0; i < size; ++i)
+            {
+                tails[n_tails] = i;
+                n_tails += !(fabs(ups[i] - 0.5) < 0.42);
+            }
+            for (size_t k = 0; k < n_tails; ++k) central[tails[k]] = -signs[tails[k]] * moro::tail(ups[tails[k]]);
+
+            for (size_t i = 0; i < size; ++i) res[first + i] = central[i];
+        }
+    }
 } // end of namespace
 
 #endif
\ No newline at end of file
@@ -0,0 +1,382 @@
+#ifndef LEVEL_SWEEP_HPP
+#define LEVEL_SWEEP_HPP
+
+// STL includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+// user includes
+#include "Tape.hpp"
+
+// Parallel reverse sweep of one tape by level scheduling, for whole runs recorded without marks.
+// The analysis (analyse()) gives every node in [to, from] a level: 1 + the highest level of its
+// children, children below 'to' being level 0. Nodes of a level do not depend on each other and the
+// parents of a node have higher levels. The schedule holds the nodes by descending level, each with
+// the parents it gathers its adjoint from (the transposed DAG) and the partial derivatives.
+// Hubs, nodes with at least hub_parents parents (inputs, surface nodes, mu, ...), do not gather: their
+// parents push into accumulation slots, which a hub sums when its level is reached.
+// sweep_levels() sweeps the levels from the top. A level is cut in chunks of 'chunk' nodes, chunk c
+// pushes into slot c % slots and slot s belongs to thread s % threads, with slots = max(n_slots, threads),
+// so no adjoint or slot is written by two threads. Big levels are split over the threads with a barrier
+// after each, consecutive small levels (e.g. a running sum over paths) run on one thread.
+// Each adjoint is summed in an order fixed by the schedule, the chunk size and the number of slots, so the
+// adjoints are identical for any number of threads up to n_slots. They match Tape::propagate(from, to) up
+// to the order of the sums into hubs (bit-identical without hubs).
+// Costs, in serial sweeps of the same range (bench_level_sweep, one core): the analysis about analysis_cost
+// (the levels and their counting sort are serial, the entries and the transposition run on 'threads'
+// threads with the same result), a level sweep on one thread about gather_cost (the reads of the parents
+// and seeds are scattered). barrier_cost is an estimate, and the speedup over threads is not measured:
+// the test machine has one core. propagate() builds the schedule only when the sweeps it is expected to
+// serve pay for the analysis (worth_building()), and runs the levels only when the threads (at most the
+// hardware threads) beat the serial sweep (pays_off()), else it runs Tape::propagate(from, to).
+// The schedule takes 24 bytes per node and 12 per argument, and 20 more per node during the analysis.
+// It is valid until the tape is rewound or cleared, and can be reused for sweeps with other seeds in
+// [to, from] (e.g. one per output).
+class Level_schedule
+{
+public:
+    using index_t = Tape::index_t;
+
+    // accumulation slots per hub, the adjoints are identical for up to n_slots threads
+    static constexpr size_t n_slots = 64;
+    // time of the analysis in serial sweeps, of a gathered node and of a barrier in nodes of the serial sweep
+    static constexpr double analysis_cost = 24.;
+    static constexpr double gather_cost   = 2.5;
+    static constexpr double barrier_cost  = 2000.;
+
+private:
+    Tape&   my_tape;
+    size_t  my_from;
+    size_t  my_to;
+    size_t  my_hub_parents;
+    bool    my_analysed = false;
+
+    // Node at a position of the schedule: its hub index (passive_index if not a hub), and where its parents
+    // and hub children start. The parents (positions) of entry k are in [parents, my_entries[k + 1].parents)
+    // with d parent / d node, its hub children in [pushes, my_entries[k + 1].pushes) with d node / d hub.
+    struct Entry
+    {
+        size_t  parents, pushes;
+        index_t node, hub;
+    };
+
+    // entries by descending level and a last one with the ends, first position of each level
+    // (my_level_begin[k], k = 0 is the top)
+    std::vector<Entry>      my_entries;
+    std::vector<size_t>     my_level_begin;
+    std::vector<index_t>    my_parents;
+    std::vector<double>     my_weights;
+    size_t                  my_n_hubs = 0;
+    std::vector<index_t>    my_push_hubs;
+    std::vector<double>     my_push_weights;
+
+    // adjoints by position and accumulation slots (slots per hub) during a sweep
+    std::vector<double>     my_adjoints;
+    std::vector<double>     my_slots;
+    size_t                  my_n_slots = n_slots;
+
+    // runs of levels [first, last), split over the threads or on the calling thread
+    struct Segment {size_t first, last; bool parallel;};
+
+    // Blocking barrier of a fixed number of threads
+    class Barrier
+    {
+        std::mutex              my_mutex;
+        std::condition_variable my_cv;
+        const size_t            my_threads;
+        size_t                  my_arrived    = 0;
+        size_t                  my_generation = 0;
+
+    public:
+        explicit Barrier(const size_t threads) : my_threads(threads) {}
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(my_mutex);
+            const size_t generation = my_generation;
+            if (++my_arrived == my_threads)
+            {
+                my_arrived = 0;
+                ++my_generation;
+                my_cv.notify_all();
+            }
+            else my_cv.wait(lock, [&] {return my_generation != generation;});
+        }
+    };
+
+public:
+    // Schedule of the nodes in [to, from], analysed on first use
+    Level_schedule(Tape& tape, const size_t from, const size_t to = 0, const size_t hub_parents = 256)
+        : my_tape(tape), my_from(from), my_to(to), my_hub_parents(hub_parents)
+    {
+        if (from >= tape.nodes() || to > from) {std::__throw_runtime_error("Level_schedule: nodes not on tape");}
+    }
+
+    // Builds the schedule on 'threads' threads, once
+    void analyse(const size_t threads = 1)
+    {
+        if (my_analysed) return;
+        if (my_tape.my_float) build(my_tape.my_float_weights, my_hub_parents, std::max<size_t>(1, threads));
+        else                  build(my_tape.my_weights, my_hub_parents, std::max<size_t>(1, threads));
+        my_analysed = true;
+    }
+
+    bool   analysed() const {return my_analysed;}
+    // after analyse()
+    size_t levels() const {return my_level_begin.size() - 1;}
+    size_t nodes()  const {return my_entries.size() - 1;}
+    size_t hubs()   const {return my_n_hubs;}
+
+    static size_t cores(const size_t threads)
+    {
+        return std::min<size_t>(threads, std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    // Whether the analysis and 'sweeps' level sweeps on 'threads' threads are estimated faster than 'sweeps'
+    // serial sweeps, at best (no barriers): with 8 cores from about 35 sweeps, never below 3 cores
+    static bool worth_building(const size_t threads, const size_t sweeps)
+    {
+        return analysis_cost + double(sweeps) * gather_cost / double(cores(threads)) < double(sweeps);
+    }
+
+    // Whether the level sweep on 'threads' threads is estimated faster than the serial sweep (after analyse())
+    bool pays_off(const size_t threads, const size_t chunk = 1024) const
+    {
+        const size_t cores = Level_schedule::cores(threads);
+        if (cores < 2) return false;
+        double cost = 0;
+        for (const Segment& segment : segments(threads, chunk))
+        {
+            const double n = double(my_level_begin[segment.last] - my_level_begin[segment.first]);
+            cost += segment.parallel ? gather_cost * n / cores + barrier_cost : gather_cost * n;
+        }
+        return cost < double(my_from - my_to + 1);
+    }
+
+    // Reverse sweep from the adjoints seeded in [to, from] as Tape::propagate(from, to). 'sweeps' is the number
+    // of sweeps the schedule is expected to serve, this one included. Not yet analysed, the schedule is built
+    // when worth_building(threads, sweeps), else the sweep is serial. Analysed, the level sweep runs when
+    // pays_off(threads, chunk), else the serial sweep.
+    void propagate(const size_t threads, const size_t sweeps = 1, const size_t chunk = 1024)
+    {
+        if (!my_analysed && worth_building(threads, sweeps)) analyse(threads);
+        if (my_analysed && pays_off(threads, chunk)) sweep_levels(threads, chunk);
+        else my_tape.propagate(my_from, my_to);
+    }
+
+    // Level sweep on 'threads' threads (the calling thread included), analysed first if needed. A level runs
+    // in parallel when it has a chunk per thread.
+    void sweep_levels(size_t threads, const size_t chunk = 1024)
+    {
+        analyse(threads);
+        const auto start = std::chrono::steady_clock::now();
+        threads    = std::max<size_t>(1, threads);
+        my_n_slots = std::max(n_slots, threads);
+        my_adjoints.resize(nodes());
+        my_slots.assign(my_n_slots * my_n_hubs, 0.);
+
+        const std::vector<Segment> run = segments(threads, chunk);
+        Barrier barrier(threads);
+
+        auto worker = [&](const size_t thread)
+        {
+            for (const Segment& segment : run)
+            {
+                if (segment.parallel || !thread)
+                {
+                    for (size_t k = segment.first; k < segment.last; ++k)
+                    {
+                        for (size_t c = 0, n = chunks(k, chunk); c < n; ++c)
+                        {
+                            const size_t slot = c % my_n_slots;
+                            if (segment.parallel && slot % threads != thread) continue;
+                            const size_t first = my_level_begin[k] + c * chunk;
+                            gather(first, std::min(first + chunk, my_level_begin[k + 1]), slot);
+                        }
+                    }
+                }
+                if (threads > 1) barrier.wait();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t thread = 1; thread < threads; ++thread) workers.emplace_back(worker, thread);
+        worker(0);
+        for (auto& thread : workers) thread.join();
+
+        my_tape.time_sweep(start);
+    }
+
+private:
+    size_t chunks(const size_t k, const size_t chunk) const
+    {
+        return (my_level_begin[k + 1] - my_level_begin[k] + chunk - 1) / chunk;
+    }
+
+    std::vector<Segment> segments(const size_t threads, const size_t chunk) const
+    {
+        std::vector<Segment> res;
+        for (size_t k = 0; k < levels(); ++k)
+        {
+            const bool parallel = threads > 1 && chunks(k, chunk) >= threads;
+            if (!parallel && !res.empty() && !res.back().parallel) res.back().last = k + 1;
+            else res.push_back({k, k + 1, parallel});
+        }
+        return res;
+    }
+
+    // Adjoints of the nodes at positions [first, last) from their seeds on tape (their parents are final),
+    // pushed to their hub children in 'slot'
+    void gather(const size_t first, const size_t last, const size_t slot)
+    {
+        double* adjoints = my_tape.my_adjoints.data();
+        for (size_t k = first; k < last; ++k)
+        {
+            const Entry& entry = my_entries[k];
+            double sum = adjoints[entry.node];
+            if (entry.hub != Tape::passive_index)
+            {
+                const double* slots = &my_slots[entry.hub * my_n_slots];
+                for (size_t s = 0; s < my_n_slots; ++s) sum += slots[s];
+            }
+            else
+            {
+                for (size_t i = entry.parents, end = my_entries[k + 1].parents; i < end; ++i)
+                {
+                    // parents with adjoint 0 are skipped as in the serial sweep
+                    const double parent = my_adjoints[my_parents[i]];
+                    if (parent) sum += my_weights[i] * parent;
+                }
+            }
+            my_adjoints[k] = adjoints[entry.node] = sum;
+
+            if (!sum) continue;
+            for (size_t i = entry.pushes, end = my_entries[k + 1].pushes; i < end; ++i)
+            {
+                my_slots[my_push_hubs[i] * my_n_slots + slot] += my_push_weights[i] * sum;
+            }
+        }
+    }
+
+    template<typename W>
+    void build(const containers::List_array<W>& weights, const size_t hub_parents, const size_t threads)
+    {
+        const Tape& tape = my_tape;
+        auto arg_end = [&](const size_t node) {return node + 1 < tape.nodes() ? tape.my_arg_begin[node + 1] : tape.args();};
+
+        // levels and number of parents, in recording order
+        std::vector<index_t> level(my_from + 1, 0), count(my_from + 1, 0);
+        index_t top = 0;
+        for (size_t node = my_to; node <= my_from; ++node)
+        {
+            index_t highest = 0;
+            for (size_t arg = tape.my_arg_begin[node], end = arg_end(node); arg < end; ++arg)
+            {
+                const index_t child = tape.my_children[arg];
+                highest = std::max(highest, level[child]);
+                ++count[child];
+            }
+            level[node] = highest + 1;
+            top = std::max(top, level[node]);
+        }
+
+        // counting sort by descending level, level 0 holds the children below 'to'
+        my_level_begin.assign(size_t(top) + 2, 0);
+        for (size_t node = 0; node <= my_from; ++node)
+            if (node >= my_to || count[node]) ++my_level_begin[top - level[node] + 1];
+        for (size_t k = 1; k < my_level_begin.size(); ++k) my_level_begin[k] += my_level_begin[k - 1];
+
+        const size_t n = my_level_begin.back();
+        my_entries.assign(n + 1, Entry{0, 0, 0, Tape::passive_index});
+        std::vector<size_t> next(my_level_begin.begin(), my_level_begin.end() - 1);
+        for (size_t node = 0; node <= my_from; ++node)
+        {
+            if (node < my_to && !count[node]) continue;
+            const size_t position = next[top - level[node]]++;
+            my_entries[position].node = index_t(node);
+            // the level is not needed anymore, keep the position
+            level[node] = index_t(position);
+        }
+
+        // hubs by node
+        std::vector<index_t> hubs(my_from + 1, Tape::passive_index);
+        for (size_t node = 0; node <= my_from; ++node) if (count[node] >= hub_parents) hubs[node] = index_t(my_n_hubs++);
+
+        // The rest on 'threads' threads, thread t on the nodes in [bounds[t], bounds[t + 1])
+        std::vector<size_t> bounds(threads + 1);
+        for (size_t t = 0; t <= threads; ++t) bounds[t] = t * (my_from + 1) / threads;
+        auto on_threads = [&](auto f)
+        {
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < threads; ++t) workers.emplace_back(f, bounds[t], bounds[t + 1]);
+            f(bounds[0], bounds[1]);
+            for (auto& thread : workers) thread.join();
+        };
+        auto positioned = [&](const size_t node) {return node >= my_to || count[node];};
+
+        // number of parents gathered and of hub children of the entries, then their first positions
+        on_threads([&](const size_t first, const size_t last)
+        {
+            for (size_t node = first; node < last; ++node)
+            {
+                if (!positioned(node)) continue;
+                Entry& entry = my_entries[level[node]];
+                entry.hub     = hubs[node];
+                entry.parents = hubs[node] == Tape::passive_index ? count[node] : 0;
+                // nodes below 'to' push nothing
+                if (node < my_to) continue;
+                for (size_t arg = tape.my_arg_begin[node], end = arg_end(node); arg < end; ++arg)
+                    entry.pushes += hubs[tape.my_children[arg]] != Tape::passive_index;
+            }
+        });
+        size_t n_parents = 0, n_pushes = 0;
+        for (Entry& entry : my_entries)
+        {
+            const size_t parents = entry.parents, pushes = entry.pushes;
+            entry.parents = n_parents;
+            entry.pushes  = n_pushes;
+            n_parents += parents;
+            n_pushes  += pushes;
+        }
+        my_parents.resize(n_parents);
+        my_weights.resize(n_parents);
+        my_push_hubs.resize(n_pushes);
+        my_push_weights.resize(n_pushes);
+
+        // Transposed DAG in the order of the serial sweep: last parent first, arguments in order.
+        // A thread writes the hub children of its nodes and the parents of its (non hub) nodes, which are
+        // all above its first node. The result does not depend on the number of threads.
+        next.assign(my_from + 1, 0);
+        on_threads([&](const size_t first, const size_t last)
+        {
+            for (size_t node = first; node < last; ++node) if (positioned(node)) next[node] = my_entries[level[node]].parents;
+            for (size_t node = my_from + 1; node-- > std::max(my_to, first);)
+            {
+                const bool own = node < last;
+                size_t push = own ? my_entries[level[node]].pushes : 0;
+                for (size_t arg = tape.my_arg_begin[node], end = arg_end(node); arg < end; ++arg)
+                {
+                    const index_t child = tape.my_children[arg];
+                    if (hubs[child] != Tape::passive_index)
+                    {
+                        if (!own) continue;
+                        my_push_hubs[push]      = hubs[child];
+                        my_push_weights[push++] = weights[arg];
+                    }
+                    else if (child >= first && child < last)
+                    {
+                        const size_t i = next[child]++;
+                        my_parents[i] = level[node];
+                        my_weights[i] = weights[arg];
+                    }
+                }
+            }
+        });
+    }
+};
+
+#endif
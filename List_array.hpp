@@ -2,85 +2,232 @@
 #define LIST_ARRAY_HPP
 
 // STL includes
-#include <array>
-#include <list>
 #include <iterator>
 #include <algorithm>
+#include <vector>
+#include <new>
+#include <utility>
+#include <type_traits>
+#include <iostream>
+
+// user includes
+#include "Arena.hpp"
 
 namespace containers
 {
-    template<typename T, size_t SIZE>
+    // Chunked array. Objects are placed in blocks of block_size() entries, a power of 2 set at runtime.
+    // Blocks never move, so pointers and position handles (block * block_size() + offset) stay valid.
+    // Blocks are raw storage, an object is constructed by emplace_back() and destroyed by clear() or rewind().
+    // Blocks emptied by clear() or rewind() go on a free list and are reused before new ones are allocated,
+    // so repeated runs in one process allocate only once, trim() gives them back to the allocator after a
+    // big run. Blocks come from a Block_allocator (see Arena.hpp), the heap by default.
+    template<typename T>
     class List_array
     {
     private:
-        // main container
-        std::list<std::array<T, SIZE>> container;
-
-        // iterator types inferred using decltype
-        using list_iterator  = decltype(container.begin());
-        using array_iterator = decltype(container.front().begin());
-
-        // iterators
-        // current array
-        list_iterator  current_array;
-        // last array in list
-        list_iterator last_array;
-        // current entry in current_array
-        array_iterator current_entry;
-        // last entry in the current_array
-        array_iterator last_entry;
-
-        // marked iterator
-        list_iterator mark_array;
-        // marked entry in array
-        array_iterator mark_entry;
-    
-        // Adds new array to the list. 
-        void extend_list()
+        // block size, position = (block << shift) + (position & mask)
+        size_t size_block = 0;
+        size_t shift      = 0;
+        size_t mask       = 0;
+
+        // blocks in use, in order, and emptied blocks kept for reuse
+        std::vector<T*> blocks;
+        std::vector<T*> free_blocks;
+
+        // index of the current block in blocks, next entry and end of the current block
+        size_t current_block = 0;
+        T*     current_entry = nullptr;
+        T*     last_entry    = nullptr;
+
+        // marked position
+        size_t mark_position = 0;
+
+        // memory of the blocks
+        Block_allocator* allocator = &Heap_allocator::instance();
+
+        T* allocate(const size_t n)
         {
-            container.emplace_back();
-            current_array = std::prev(container.end());
-            last_array    = current_array;
-            current_entry = current_array->begin();
-            last_entry    = current_array->end();
+            return static_cast<T*>(allocator->allocate(n * sizeof(T)));
         }
 
-        // moves to the next array
-        void next_array()
+        // Adds a block to the end, from the free list if possible
+        void extend_list()
         {
-            if(current_array == last_array)
+            if (free_blocks.empty())
             {
-                extend_list();
+                blocks.push_back(allocate(size_block));
             }
             else
             {
-                ++current_array;
-                current_entry = current_array->begin();
-                last_entry    = current_array->end();
+                blocks.push_back(free_blocks.back());
+                free_blocks.pop_back();
             }
         }
 
+        // moves to the next block, the current one is full
+        void next_array()
+        {
+            allocator->seal(blocks[current_block], size_block * sizeof(T));
+            if (current_block + 1 == blocks.size())
+            {
+                extend_list();
+            }
+            ++current_block;
+            current_entry = blocks[current_block];
+            last_entry    = current_entry + size_block;
+        }
+
+        // Destroys the objects in positions [from, to)
+        void destroy(const size_t from, const size_t to)
+        {
+            if (std::is_trivially_destructible<T>::value) return;
+            for (size_t position = from; position < to; ++position) (*this)[position].~T();
+        }
+
+        // Destroys all objects and deallocates all blocks
+        void release()
+        {
+            if (!blocks.empty()) destroy(0, size());
+            for (T* block : blocks)      allocator->deallocate(block, size_block * sizeof(T));
+            for (T* block : free_blocks) allocator->deallocate(block, size_block * sizeof(T));
+            blocks.clear();
+            free_blocks.clear();
+        }
+
     public:
         bool marked = false;
-        // CTOR: Immediately construct an array in the list and set List_array iterators. 
-        List_array()
+        // CTOR: Immediately allocate a block, block_size_ is rounded up to a power of 2
+        explicit List_array(const size_t block_size_ = 65536)
         {
+            set_block_size(block_size_);
+        }
+
+        ~List_array()
+        {
+            release();
+        }
+
+        // Blocks are owned
+        List_array(const List_array&) = delete;
+        List_array& operator=(const List_array&) = delete;
+
+        // Changes the block size. Clears the container and deallocates its blocks.
+        void set_block_size(const size_t block_size_)
+        {
+            release();
+            for (shift = 0; (size_t(1) << shift) < block_size_; ++shift);
+            size_block = size_t(1) << shift;
+            mask       = size_block - 1;
+
             extend_list();
+            current_block = 0;
+            current_entry = blocks[0];
+            last_entry    = current_entry + size_block;
+            marked        = false;
+            mark_position = 0;
+        }
+
+        size_t block_size() const {return size_block;}
+
+        // Changes the allocator of the blocks. Clears the container and deallocates its blocks.
+        void set_allocator(Block_allocator& allocator_)
+        {
+            release();
+            allocator = &allocator_;
+            set_block_size(size_block);
         }
 
         void set_mark()
         {
             marked = true;
-            mark_array = current_array;
-            mark_entry = current_entry;
+            mark_position = size();
         }
 
         void go_to_mark()
         {
             if (!marked) {std::__throw_runtime_error("Tape not marked, cannot call 'List_array::go_to_mark()'");}
-            current_array = mark_array;
-            current_entry = mark_entry;
-            last_entry    = current_array->end();
+            rewind(mark_position);
+        }
+
+        // Moves back to a position handle, the next emplaced object goes to 'position'.
+        // Objects after it are destroyed and the blocks after its block go on the free list.
+        void rewind(const size_t position)
+        {
+            if (position > size()) {std::__throw_runtime_error("Position past the end, cannot call 'List_array::rewind()'");}
+            destroy(position, size());
+
+            size_t block = position >> shift;
+            // a full last block has no successor yet
+            if (block == blocks.size()) --block;
+            while (blocks.size() > block + 1)
+            {
+                free_blocks.push_back(blocks.back());
+                blocks.pop_back();
+            }
+            current_block = block;
+            current_entry = blocks[block] + (position - (block << shift));
+            last_entry    = blocks[block] + size_block;
+        }
+
+        // Number of positions used, i.e. the position of the next emplaced object
+        size_t size() const
+        {
+            return (current_block << shift) + (current_entry - blocks[current_block]);
+        }
+
+        // Position handle of the most recently emplaced object
+        size_t last_position() const
+        {
+            return size() - 1;
+        }
+
+        // access by position handle, constant time
+        T& operator[](const size_t position)
+        {
+            return blocks[position >> shift][position & mask];
+        }
+
+        const T& operator[](const size_t position) const
+        {
+            return blocks[position >> shift][position & mask];
+        }
+
+        // Number of blocks in use and on the free list
+        size_t n_blocks() const
+        {
+            return blocks.size();
+        }
+
+        size_t n_free_blocks() const
+        {
+            return free_blocks.size();
+        }
+
+        // Deallocates the blocks on the free list but 'keep', the blocks in use stay
+        void trim(const size_t keep = 0)
+        {
+            while (free_blocks.size() > keep)
+            {
+                allocator->deallocate(free_blocks.back(), size_block * sizeof(T));
+                free_blocks.pop_back();
+            }
+        }
+
+        // index of the block holding a position
+        size_t block_of(const size_t position) const
+        {
+            return position >> shift;
+        }
+
+        // raw storage of the block with index b (positions [b * block_size(), (b + 1) * block_size()))
+        T* block(const size_t b)
+        {
+            return blocks[b];
+        }
+
+        const T* block(const size_t b) const
+        {
+            return blocks[b];
         }
 
         // places object in next entry and returns pointer to this
@@ -94,57 +241,40 @@ namespace containers
             }
             // https://en.cppreference.com/w/cpp/utility/forward
             // In-place construction using new
-            T* object = new (&*current_entry) T(std::forward<Args>(args)...);
+            T* object = new (current_entry) T(std::forward<Args>(args)...);
             ++current_entry;
 
             return object;
         }
 
-        template<size_t n>
-        T* emplace_back_n()
+        // Reverse iteration by blocks: calls f(first, last, position of first) on the raw ranges
+        // covering positions [from, to), from the last block to the first.
+        template<typename F>
+        void for_each_block_reverse(const size_t from, const size_t to, F f)
         {
-            if(std::distance(current_entry, last_entry) < n)
+            size_t end = to;
+            while (end > from)
             {
-                next_array();
+                const size_t block  = (end - 1) >> shift;
+                const size_t offset = block << shift;
+                const size_t begin  = std::max(from, offset);
+                f(blocks[block] + (begin - offset), blocks[block] + (end - offset), begin);
+                end = begin;
             }
-
-            auto prev_entry = current_entry;
-            current_entry += n;
-
-            return &*prev_entry;
         }
-        
-        T* emplace_back_n(const size_t n)
-        {
-            if((const unsigned long)(std::distance(current_entry, last_entry)) < n)
-            {
-                next_array();
-            }
-
-            auto prev_entry = current_entry;
-            current_entry  += n;
-            
-            return &*prev_entry;
-        }
-
-        ~List_array() {}
-
 
         //print marked
         void print_mark()
         {
-            std::cout << &*mark_array << std::endl;
-            std::cout << &*mark_entry << std::endl;
+            std::cout << mark_position << std::endl;
         }
 
 
-        // nested ITERATOR class 
+        // nested ITERATOR class, a position handle
         class iterator
         {
-            list_iterator  current_array;
-            array_iterator current_entry;
-            array_iterator first_entry;
-            array_iterator last_entry;
+            List_array* owner;
+            size_t      position;
 
         public:
             // https://en.cppreference.com/w/cpp/iterator/iterator_traits
@@ -157,106 +287,75 @@ namespace containers
             using iterator_category = std::bidirectional_iterator_tag;
 
             iterator() {}
-            iterator(list_iterator current_array_, array_iterator current_entry_,
-                     array_iterator first_entry_, array_iterator last_entry_)
-            : current_array(current_array_), current_entry(current_entry_),
-              first_entry(first_entry_), last_entry(last_entry_) {};
+            iterator(List_array* owner_, const size_t position_) : owner(owner_), position(position_) {};
 
             // prefix increment operator
             iterator operator++()
             {
-                // increment to next entry
-                ++current_entry;
-                // check if increment to next array
-                if(current_entry == last_entry)
-                {
-                    ++current_array;
-                    // set iterators after incremented to next array
-                    first_entry = current_array->begin();
-                    last_entry = current_array->end();
-                    current_entry = first_entry;
-                }
+                ++position;
                 return *this;
             }
 
             // prefix decrement operator
             iterator operator--()
             {
-                // check if decrement to previous array
-                if(current_entry == first_entry)
-                {
-                    --current_array;
-                    // sets iterators after decremented to previous array
-                    first_entry = current_array->begin();
-                    last_entry = current_array->end();
-                    current_entry = last_entry;
-                }
-                // decrement current entry in any case
-                // in the case the if statement was true current entry point to past-the-end element
-                // else current entry should also be decremented
-                --current_entry;
-
+                --position;
                 return *this;
             }
 
             // access operators
             T& operator*()
             {
-                return *current_entry;
+                return (*owner)[position];
             }
 
             const T& operator*() const
             {
-                return *current_entry;
+                return (*owner)[position];
             }
 
             T* operator->()
             {
-                return &*current_entry;
+                return &(*owner)[position];
             }
-            
+
             const T* operator->() const
             {
-                return &*current_entry;
+                return &(*owner)[position];
             }
 
             // comparison operators
             bool operator==(const iterator& rhs) const
             {
-                return current_entry == rhs.current_entry;
+                return position == rhs.position;
             }
-            
+
             bool operator!=(const iterator& rhs) const
             {
-                return current_entry != rhs.current_entry;
+                return position != rhs.position;
             }
-            
+
         };
 
         iterator begin()
         {
-            auto list_begin = container.begin(); // first array of list
-            auto first_entry = list_begin->begin(); // first entry of first array of list
-            auto last_entry = list_begin->end(); // last entry(+1) of first array of list
-            // return iterator with set state
-            return iterator(list_begin, first_entry, first_entry, last_entry);
+            return iterator(this, 0);
         }
-        
+
         iterator end()
         {
-            auto list_end = current_array;
-            auto first_entry = list_end->begin(); // first entry of current array
-            auto last_entry = list_end->end(); // last entry of current array
-            // return iterator with set state where current_entry is used.
-            return iterator(list_end, current_entry, first_entry, last_entry);
+            return iterator(this, size());
         }
 
         iterator mark()
         {
-            auto marked_begin = mark_array;
-            auto marked_first_entry = marked_begin->begin();
-            auto marked_last_entry = marked_begin->end();
-            return iterator(marked_begin, mark_entry, marked_first_entry, marked_last_entry);
+            return iterator(this, mark_position);
+        }
+
+        // iterator from position handle (see last_position()), constant time
+        iterator at(const size_t position)
+        {
+            return iterator(this, position);
         }
 
         iterator find(const T& f_node)
@@ -264,10 +363,12 @@ namespace containers
             return std::find(begin(), end(), f_node);
         }
 
+        // Empties the container, the blocks are kept for reuse
         void clear()
         {
-            container.clear();
-            next_array();
+            rewind(0);
+            marked = false;
+            mark_position = 0;
         }
     };
 }
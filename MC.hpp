@@ -5,6 +5,12 @@
 #include "RNG_base.hpp"
 #include "interp.hpp"
 #include "Tdouble.hpp"
+#include "Checkpoint.hpp"
+#include "Replay.hpp"
+#include "Parallel.hpp"
+#include "Fused.hpp"
+#include "Adjoint.hpp"
+#include "Dual.hpp"
 
 template <typename T>
 T smoother(const T x, const T x_pos, const T x_neg, const double eps)
@@ -15,6 +21,22 @@ T smoother(const T x, const T x_pos, const T x_neg, const double eps)
     else              return x > 0 ? x_pos : x_neg;
 }
 
+// smoother on tape, one node per call (see fIf in Fused.hpp)
+template <>
+inline Tdouble smoother<Tdouble>(const Tdouble x, const Tdouble x_pos, const Tdouble x_neg, const double eps)
+{
+    if( eps > 0.0001) return fIf(x, x_pos, x_neg, eps);
+    else              return x > 0 ? x_pos : x_neg;
+}
+
+// smoother on the replay tape (see Replay.hpp), the kinks are replayed as max, min and select
+template <>
+inline Rdouble smoother<Rdouble>(const Rdouble x, const Rdouble x_pos, const Rdouble x_neg, const double eps)
+{
+    if( eps > 0.0001) return x_neg + (x_pos - x_neg)/eps * max( Rdouble(0.0), min(Rdouble(eps), x + eps/2.) );
+    else              return select(x, x_pos, x_neg);
+}
+
 // ------------------------------------------------------------------------------
 //                              CALL OPTION
 // ------------------------------------------------------------------------------
@@ -33,8 +55,10 @@ double MC_European_CallOption(
     auto timeline = surface.mats;
     size_t steps = timeline.size();
 
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
     std::vector<double> 
-        gaussians(steps),
+        gaussians(block * steps),
         dts(steps);
     some_rng.init(steps);
 
@@ -58,7 +82,8 @@ double MC_European_CallOption(
         // Reset counter for executable times of option
         size_t prod_step = 1;
         // Get new gaussians numbers
-        some_rng.nextG(gaussians);
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
         double runningSpot = spot;
         double res = 0.0; 
         // Loop over steps in time
@@ -71,7 +96,7 @@ double MC_European_CallOption(
                 surface.lVol[j],
                 surface.lVol[j] + surface.spots.size(),
                 runningSpot);
-            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * gaussians[j]);
+            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * z[j]);
 
             // If product can be exercised or add to value, check:
             if (prod_steps[j])
@@ -87,6 +112,29 @@ double MC_European_CallOption(
     return price / double(paths);
 }
 
+// Multithreaded MC_European_CallOption (see parallel_MC in Parallel.hpp). make_rng(chunk) gives the RNG of
+// each chunk of paths, the price does not depend on the number of threads.
+template<typename Make_rng>
+double MC_European_CallOption_Parallel(
+    const double& spot,
+    const double& rate,
+    const double& divs,
+    const double& strike,
+    const double& mat, 
+    Surface_results<double>& surface, 
+    Make_rng make_rng, 
+    const size_t& paths,
+    const Parallel_settings& settings = Parallel_settings())
+{
+    return parallel_MC(
+        [&](RNG::RNG_base& rng, const size_t n)
+        {
+            double local_strike = strike, local_mat = mat;
+            return MC_European_CallOption(spot, rate, divs, local_strike, local_mat, surface, rng, n);
+        },
+        make_rng, paths, settings);
+}
+
 double MC_European_CallOption_AAD(
     Tdouble& spot,
     Tdouble& rate,
@@ -101,8 +149,10 @@ double MC_European_CallOption_AAD(
     auto timeline = surface.mats;
     size_t steps = timeline.size();
 
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
     std::vector<double> 
-        gaussians(steps),
+        gaussians(block * steps),
         dts(steps);
     some_rng.init(steps);
 
@@ -121,32 +171,27 @@ double MC_European_CallOption_AAD(
     Tdouble mu = rate - divs;
     
     // Mark Tape! 
-    Tdouble res; 
+    Tdouble res = 0.0;
     res.set_mark();
 
     double price = 0;
     for (size_t i = 0; i < paths; ++i)
     {
         // Get new gaussians numbers
-        some_rng.nextG(gaussians);
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
         
         Tdouble runningSpot = spot;
         // Loop over steps in time
         for (size_t j = 0; j < steps; ++j)
         {
-            // Simulate dynamics. Get volatility, calc running spot.
-            Tdouble vol = interp(
-                surface.spots.begin(),
-                surface.spots.end(),
-                surface.lVol[j],
-                surface.lVol[j] + surface.spots.size(),
-                runningSpot);
-            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * gaussians[j]);
+            // Simulate dynamics. Local vol log-Euler step, one node on tape (see Fused.hpp).
+            runningSpot = local_vol_step(surface.spots, surface.lVol[j], runningSpot, mu, dts[j], z[j]);
 
             // Exercise at maturity
             if (prod_steps[j])
             {
-                res = (runningSpot > strike) ? (runningSpot - strike) / paths : 0.0;
+                res = (runningSpot > strike) ? Tdouble((runningSpot - strike) / paths) : 0.0;
                 break;
             }    
         }
@@ -161,6 +206,339 @@ double MC_European_CallOption_AAD(
     return price;
 }
 
+// Same as MC_European_CallOption_AAD, with one path recorded as a replay program (see Replay.hpp)
+// that is replayed forward and backward on every path, instead of recording every path on tape.
+double MC_European_CallOption_Replay_AAD(
+    Tdouble& spot,
+    Tdouble& rate,
+    Tdouble& divs,
+    Tdouble& strike,
+    Tdouble& mat, 
+    Surface_results<Tdouble>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, {mat.get_value()});
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // Record one path, the gaussians are the path inputs
+    Replay_tape& program = *Rdouble::tape;
+    program.clear();
+
+    Rdouble mu = Rdouble(rate) - Rdouble(divs);
+    Rdouble runningSpot = spot;
+    Rdouble res;
+    for (size_t j = 0; j < steps; ++j)
+    {
+        // Simulate dynamics. Local vol log-Euler step, one instruction (see Replay.hpp).
+        runningSpot = local_vol_step(surface.spots, surface.lVol[j], runningSpot, mu, dts[j], Rdouble::input(j));
+
+        // Exercise at maturity
+        if (prod_steps[j])
+        {
+            res = select(runningSpot - strike, (runningSpot - strike) / paths, 0.0);
+            break;
+        }
+    }
+    const Replay_tape::slot_t output = res.get_slot();
+
+    // Monte Carlo simulation
+    // Loop over paths
+    double price = 0;
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
+
+        program.replay(z);
+        price += program.value(output);
+        program.reverse(output);
+    }
+
+    // Adjoints of spot, rate, surface, ... and propagate the rest of the way 
+    program.flush_adjoints();
+    Tdouble::set_mark();
+    Tdouble::propagate_from_mark_to_start();
+    return price;
+}
+
+// Multithreaded MC_European_CallOption_AAD (see Parallel.hpp). make_rng(chunk) gives the RNG of each
+// chunk of paths, the results do not depend on the number of threads.
+template<typename Make_rng>
+double MC_European_CallOption_Parallel_AAD(
+    Tdouble& spot,
+    Tdouble& rate,
+    Tdouble& divs,
+    Tdouble& strike,
+    Tdouble& mat, 
+    Surface_results<Tdouble>& surface, 
+    Make_rng make_rng, 
+    const size_t& paths,
+    const Parallel_settings& settings = Parallel_settings())
+{
+    return parallel_AAD({&spot, &rate, &divs, &strike, &mat}, surface,
+        [](std::vector<Tdouble>& x, Surface_results<Tdouble>& local_surface, RNG::RNG_base& rng, const size_t n)
+        {
+            return MC_European_CallOption_AAD(x[0], x[1], x[2], x[3], x[4], local_surface, rng, n);
+        },
+        make_rng, paths, settings);
+}
+
+// Strike ladder of K call options on the same paths. The K prices are propagated in one vector mode
+// sweep per path, lane k holds the sensitivities of the k'th call (see Get_adjoints_SR(SR, k)).
+template<size_t K>
+std::array<double, K> MC_European_CallOption_Ladder_AAD(
+    Tdouble& spot,
+    Tdouble& rate,
+    Tdouble& divs,
+    std::array<Tdouble, K>& strikes,
+    Tdouble& mat, 
+    Surface_results<Tdouble>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, {mat.get_value()});
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // Monte Carlo simulation
+    // Loop over paths
+    Tdouble mu = rate - divs;
+    
+    // Mark Tape! 
+    Tdouble::set_lanes(K);
+    Tdouble::set_mark();
+
+    std::array<double, K> prices{};
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
+        
+        std::array<Tdouble, K> res;
+        Tdouble runningSpot = spot;
+        // Loop over steps in time
+        for (size_t j = 0; j < steps; ++j)
+        {
+            // Simulate dynamics. Local vol log-Euler step, one node on tape (see Fused.hpp).
+            runningSpot = local_vol_step(surface.spots, surface.lVol[j], runningSpot, mu, dts[j], z[j]);
+
+            // Exercise at maturity
+            if (prod_steps[j])
+            {
+                for (size_t k = 0; k < K; ++k)
+                {
+                    res[k] = (runningSpot > strikes[k]) ? Tdouble((runningSpot - strikes[k]) / paths) : 0.0;
+                    prices[k] += res[k].get_value();
+                }
+                break;
+            }    
+        }
+        Tdouble::propagate_to_mark(res); 
+        Tdouble::set_to_mark();
+    }
+
+    // Propagate the rest of the way 
+    Tdouble::propagate_from_mark_to_start<K>();
+    return prices;
+}
+
+// Forward over reverse (see Dual.hpp) through the local vol MC of a call, the payoff smoothed over eps
+// (see smoother()) so that it has a second derivative. The paths run on Dual<Tdouble> with the tangent of
+// spot set to 1, and one vector mode sweep per path is seeded with the value (lane 0) and the tangent
+// (lane 1) of the payoff. Lane 0 holds the first order sensitivities and lane 1 their derivative in spot:
+// gamma on spot.get_adjoint(1), the cross gammas to the local vols on Get_adjoints_SR(surface, 1).
+double MC_European_CallOption_Gamma_AAD(
+    Tdouble& spot,
+    Tdouble& rate,
+    Tdouble& divs,
+    Tdouble& strike,
+    Tdouble& mat, 
+    Surface_results<Tdouble>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths,
+    const double eps)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, {mat.get_value()});
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // Duals of the inputs, the tangent is the direction: spot
+    using Ddouble = Dual<Tdouble>;
+    const Ddouble dual_spot(spot, Tdouble(1.0)), dual_strike(strike, Tdouble(0.0));
+    const Ddouble mu(rate - divs, Tdouble(0.0));
+    Matrix<Ddouble> lVol(surface.lVol.get_rows(), surface.lVol.get_cols());
+    for (size_t i = 0; i < lVol.get_rows(); ++i)
+        for (size_t j = 0; j < lVol.get_cols(); ++j)
+            lVol[i][j] = Ddouble(surface.lVol[i][j], Tdouble(0.0));
+
+    // Mark Tape! 
+    Tdouble::set_lanes(2);
+    Tdouble::set_mark();
+
+    double price = 0;
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
+
+        Ddouble res = 0.0;
+        Ddouble runningSpot = dual_spot;
+        // Loop over steps in time
+        for (size_t j = 0; j < steps; ++j)
+        {
+            // Simulate dynamics. Get volatility, calc running spot.
+            Ddouble vol = interp(
+                surface.spots.begin(),
+                surface.spots.end(),
+                lVol[j],
+                lVol[j] + surface.spots.size(),
+                runningSpot);
+            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * z[j]);
+
+            // Exercise at maturity
+            if (prod_steps[j])
+            {
+                const Ddouble intrinsic = runningSpot - dual_strike;
+                res = smoother(intrinsic, intrinsic, Ddouble(0.0), eps) / double(paths);
+                break;
+            }
+        }
+        price += res.value().get_value();
+        Tdouble::propagate_to_mark(std::array<Tdouble, 2>{res.value(), res.tangent()}); 
+        Tdouble::set_to_mark();
+    }
+
+    // Propagate the rest of the way 
+    Tdouble::propagate_from_mark_to_start<2>();
+    return price;
+}
+
+// Hand written adjoint of MC_European_CallOption_AAD without tape (see Adjoint.hpp).
+// Returns the price, the adjoints are written to adjoints (lVol as Get_adjoints_SR).
+double MC_European_CallOption_Adjoint(
+    const double& spot,
+    const double& rate,
+    const double& divs,
+    const double& strike,
+    const double& mat, 
+    Surface_results<double>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths,
+    MC_adjoints& adjoints)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, {mat});
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // the path ends at maturity
+    const size_t n_steps = std::distance(prod_steps.begin(), std::find(prod_steps.begin(), prod_steps.end(), true)) + 1;
+
+    adjoints = MC_adjoints();
+    adjoints.lVol = Matrix<double>(surface.lVol.get_rows(), surface.lVol.get_cols());
+    if (n_steps > steps) return 0.;
+
+    // Monte Carlo simulation
+    // Loop over paths
+    const double mu = rate - divs;
+    double price = 0, mu_adjoint = 0;
+    Local_vol_path path(surface.spots, steps);
+    std::vector<double> spot_adjoints(steps, 0.);
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
+        path.simulate(spot, surface.lVol, mu, dts, z, n_steps);
+
+        // Exercise at maturity
+        const double s = path.spot(n_steps - 1);
+        if (s > strike)
+        {
+            price += (s - strike) / paths;
+            spot_adjoints[n_steps - 1] = 1. / paths;
+            adjoints.strike -= 1. / paths;
+            adjoints.spot   += path.reverse(spot_adjoints, surface.lVol, dts, z, adjoints.lVol, mu_adjoint);
+        }
+    }
+    adjoints.rate =  mu_adjoint;
+    adjoints.divs = -mu_adjoint;
+
+    return price;
+}
+
 // ------------------------------------------------------------------------------
 //                                 BARRIER
 // ------------------------------------------------------------------------------
@@ -181,8 +559,10 @@ double MC_European_Barrier(
     auto timeline = surface.mats;
     size_t steps = timeline.size();
 
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
     std::vector<double> 
-        gaussians(steps),
+        gaussians(block * steps),
         dts(steps);
     some_rng.init(steps);
 
@@ -206,7 +586,8 @@ double MC_European_Barrier(
         // Reset counter for executable times of option
         size_t prod_step = 1;
         // Get new gaussians numbers
-        some_rng.nextG(gaussians);
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
         double runningSpot = spot;
         double res = 0.0; 
         double alive = 1.0;
@@ -220,7 +601,7 @@ double MC_European_Barrier(
                 surface.lVol[j],
                 surface.lVol[j] + surface.spots.size(),
                 runningSpot);
-            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * gaussians[j]);
+            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * z[j]);
 
             // Smoothing 
             alive = alive * smoother<double>(runningSpot - upper, 0, 1, epsilon);
@@ -239,6 +620,30 @@ double MC_European_Barrier(
     return price / double(paths);
 }
 
+// Multithreaded MC_European_Barrier, as MC_European_CallOption_Parallel
+template<typename Make_rng>
+double MC_European_Barrier_Parallel(
+    const double& spot,
+    const double& rate,
+    const double& divs,
+    const double& strike,
+    const double& mat, 
+    const double& upper, 
+    Surface_results<double>& surface, 
+    Make_rng make_rng, 
+    const size_t& paths,
+    const double epsilon,
+    const Parallel_settings& settings = Parallel_settings())
+{
+    return parallel_MC(
+        [&](RNG::RNG_base& rng, const size_t n)
+        {
+            double x[6] = {spot, rate, divs, strike, mat, upper};
+            return MC_European_Barrier(x[0], x[1], x[2], x[3], x[4], x[5], surface, rng, n, epsilon);
+        },
+        make_rng, paths, settings);
+}
+
 double MC_European_Barrier_AAD(
     const Tdouble& spot,
     const Tdouble& rate,
@@ -255,8 +660,10 @@ double MC_European_Barrier_AAD(
     auto timeline = surface.mats;
     size_t steps = timeline.size();
 
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
     std::vector<double> 
-        gaussians(steps),
+        gaussians(block * steps),
         dts(steps);
     some_rng.init(steps);
 
@@ -276,27 +683,21 @@ double MC_European_Barrier_AAD(
     double price = 0;
     
     // MArk Tape 
-    Tdouble res; 
+    Tdouble res = 0.0;
     res.set_mark();
     for (size_t i = 0; i < paths; ++i)
     {
         // Get new gaussians numbers
-        some_rng.nextG(gaussians);
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
 
         Tdouble alive = 1.0;
         Tdouble runningSpot = spot;
         // Loop over steps in time
         for (size_t j = 0; j < steps; ++j)
         {
-            // Simulate dynamics. Get volatility, calc running spot.
-            Tdouble vol = interp(
-                surface.spots.begin(),
-                surface.spots.end(),
-                surface.lVol[j],
-                surface.lVol[j] + surface.spots.size(),
-                runningSpot);
-            
-            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * gaussians[j]);
+            // Simulate dynamics. Local vol log-Euler step, one node on tape (see Fused.hpp).
+            runningSpot = local_vol_step(surface.spots, surface.lVol[j], runningSpot, mu, dts[j], z[j]);
 
             // Smoothing 
             alive = alive * smoother<Tdouble>(runningSpot - upper, 0, 1, epsilon);
@@ -306,7 +707,7 @@ double MC_European_Barrier_AAD(
             {
                 // Call Smooth Payoff
                 // res = alive * payoffs::europeans::Call_standard<Tdouble>(runningSpot, strike);
-                res = (runningSpot > strike) ? alive * (runningSpot - strike) / paths : 0.0;
+                res = (runningSpot > strike) ? Tdouble(alive * (runningSpot - strike) / paths) : 0.0;
                 break;
             }
         }
@@ -320,6 +721,102 @@ double MC_European_Barrier_AAD(
     return price;
 }
 
+// Hand written adjoint of MC_European_Barrier_AAD without tape (see Adjoint.hpp).
+// Returns the price, the adjoints are written to adjoints (lVol as Get_adjoints_SR).
+double MC_European_Barrier_Adjoint(
+    const double& spot,
+    const double& rate,
+    const double& divs,
+    const double& strike,
+    const double& mat, 
+    const double& upper, 
+    Surface_results<double>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths,
+    const double epsilon,
+    MC_adjoints& adjoints)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, {mat});
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // the path ends at maturity
+    const size_t n_steps = std::distance(prod_steps.begin(), std::find(prod_steps.begin(), prod_steps.end(), true)) + 1;
+
+    adjoints = MC_adjoints();
+    adjoints.lVol = Matrix<double>(surface.lVol.get_rows(), surface.lVol.get_cols());
+    if (n_steps > steps) return 0.;
+
+    // Monte Carlo simulation
+    // Loop over paths
+    const double mu = rate - divs;
+    double price = 0, mu_adjoint = 0;
+    Local_vol_path path(surface.spots, steps);
+    std::vector<double> 
+        spot_adjoints(steps, 0.),
+        alives(steps),                  // alive before the smoothing of step j
+        smooth(steps),                  // smoothing factor of step j
+        smooth_dx(steps);               // and its derivative to the spot
+    double dpos, dneg;
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
+        path.simulate(spot, surface.lVol, mu, dts, z, n_steps);
+
+        double alive = 1.0;
+        for (size_t j = 0; j < n_steps; ++j)
+        {
+            alives[j] = alive;
+            smooth[j] = smoother_adjoint(path.spot(j) - upper, 0, 1, epsilon, smooth_dx[j], dpos, dneg);
+            alive     = alive * smooth[j];
+        }
+
+        // Exercise at maturity
+        const double s = path.spot(n_steps - 1);
+        if (s > strike)
+        {
+            price += alive * (s - strike) / paths;
+            spot_adjoints[n_steps - 1] = alive / paths;
+            adjoints.strike -= alive / paths;
+
+            // back through the alive products
+            double alive_adjoint = (s - strike) / paths;
+            for (size_t j = n_steps; j-- > 0;)
+            {
+                const double x_adjoint = alive_adjoint * alives[j] * smooth_dx[j];
+                spot_adjoints[j] += x_adjoint;
+                adjoints.upper   -= x_adjoint;
+                alive_adjoint    *= smooth[j];
+            }
+            adjoints.spot += path.reverse(spot_adjoints, surface.lVol, dts, z, adjoints.lVol, mu_adjoint);
+            std::fill(spot_adjoints.begin(), spot_adjoints.end(), 0.);
+        }
+    }
+    adjoints.rate =  mu_adjoint;
+    adjoints.divs = -mu_adjoint;
+
+    return price;
+}
+
 // ------------------------------------------------------------------------------
 //                              AUTO CALLABLE
 // ------------------------------------------------------------------------------
@@ -342,8 +839,10 @@ double MC_Auto_Callable(
     auto timeline = surface.mats;
     size_t steps = timeline.size();
 
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
     std::vector<double> 
-        gaussians(steps),
+        gaussians(block * steps),
         dts(steps);
     some_rng.init(steps);
 
@@ -366,7 +865,8 @@ double MC_Auto_Callable(
         // Reset counter for executable times of option
         size_t prod_step = 1;
         // Get new gaussians numbers
-        some_rng.nextG(gaussians);
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
         double runningSpot = spot;
         double res = 0.0; 
         double alive = 1.0;
@@ -380,7 +880,7 @@ double MC_Auto_Callable(
                 surface.lVol[j],
                 surface.lVol[j] + surface.spots.size(),
                 runningSpot);
-            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * gaussians[j]);
+            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * z[j]);
 
             // Exercise ?
             if (prod_steps[j])
@@ -421,6 +921,32 @@ double MC_Auto_Callable(
     return price / double(paths);
 }
 
+// Multithreaded MC_Auto_Callable, as MC_European_CallOption_Parallel
+template<typename Make_rng>
+double MC_Auto_Callable_Parallel(
+    const double& spot,
+    const double& rate,
+    const double& divs,
+    const double& coupon,
+    const double& upper, 
+    const double& lower, 
+    const double& anchor, 
+    const std::vector<double>& times,
+    Surface_results<double>& surface, 
+    Make_rng make_rng, 
+    const size_t& paths,
+    const double epsilon,
+    const Parallel_settings& settings = Parallel_settings())
+{
+    return parallel_MC(
+        [&](RNG::RNG_base& rng, const size_t n)
+        {
+            double x[7] = {spot, rate, divs, coupon, upper, lower, anchor};
+            return MC_Auto_Callable(x[0], x[1], x[2], x[3], x[4], x[5], x[6], times, surface, rng, n, epsilon);
+        },
+        make_rng, paths, settings);
+}
+
 double MC_Auto_Callable_AAD(
     const Tdouble& spot,
     const Tdouble& rate,
@@ -439,8 +965,10 @@ double MC_Auto_Callable_AAD(
     auto timeline = surface.mats;
     size_t steps = timeline.size();
 
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
     std::vector<double> 
-        gaussians(steps),
+        gaussians(block * steps),
         dts(steps);
     some_rng.init(steps);
 
@@ -460,7 +988,7 @@ double MC_Auto_Callable_AAD(
     double price = 0;
     
     
-    Tdouble res; 
+    Tdouble res = 0.0;
     res.set_mark();
     for (size_t i = 0; i < paths; ++i)
     {
@@ -468,21 +996,16 @@ double MC_Auto_Callable_AAD(
         size_t prod_step = 1;
         
         // Get new gaussians numbers
-        some_rng.nextG(gaussians);
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
         
         Tdouble runningSpot = spot;
         Tdouble alive = 1.0;
         // Loop over steps in time
         for (size_t j = 0; j < steps; ++j)
         {
-            // Simulate dynamics. Get volatility, calc running spot.
-            Tdouble vol = interp(
-                surface.spots.begin(),
-                surface.spots.end(),
-                surface.lVol[j],
-                surface.lVol[j] + surface.spots.size(),
-                runningSpot);
-            runningSpot *= exp((mu - 0.5 * vol * vol) * dts[j] + vol * sqrt(dts[j]) * gaussians[j]);
+            // Simulate dynamics. Local vol log-Euler step, one node on tape (see Fused.hpp).
+            runningSpot = local_vol_step(surface.spots, surface.lVol[j], runningSpot, mu, dts[j], z[j]);
 
             // Exercise ?
             if (prod_steps[j])
@@ -532,4 +1055,340 @@ double MC_Auto_Callable_AAD(
     return price;
 }
 
-#endif
+// Same as MC_Auto_Callable_AAD, with one path recorded as a replay program (see Replay.hpp).
+// As there, the price sums the payoff of every exercise date and the last one is propagated.
+double MC_Auto_Callable_Replay_AAD(
+    const Tdouble& spot,
+    const Tdouble& rate,
+    const Tdouble& divs,
+    const Tdouble& coupon,
+    const Tdouble& upper, 
+    const Tdouble& lower, 
+    const Tdouble& anchor, 
+    const std::vector<double>& times,
+    Surface_results<Tdouble>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths,
+    const double epsilon)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, times);
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // Record one path, the gaussians are the path inputs
+    Replay_tape& program = *Rdouble::tape;
+    program.clear();
+
+    std::vector<Replay_tape::slot_t> payoffs;
+    Rdouble mu = Rdouble(rate) - Rdouble(divs);
+    Rdouble runningSpot = spot;
+    Rdouble alive = 1.0;
+    Rdouble res;
+    size_t prod_step = 1;
+    for (size_t j = 0; j < steps; ++j)
+    {
+        // Simulate dynamics. Local vol log-Euler step, one instruction (see Replay.hpp).
+        runningSpot = local_vol_step(surface.spots, surface.lVol[j], runningSpot, mu, dts[j], Rdouble::input(j));
+
+        // Exercise ?
+        if (prod_steps[j])
+        {
+            if (prod_step != times.size())
+            {
+                res = alive * smoother<Rdouble>(runningSpot - upper, prod_step * Rdouble(coupon), 0.0, epsilon) / paths;
+                alive = alive * smoother<Rdouble>(runningSpot - upper, 0, 1, epsilon);
+                payoffs.push_back(res.get_slot());
+            }
+            else
+            {
+                res = alive * smoother<Rdouble>(runningSpot - upper, prod_step * Rdouble(coupon), 0.0, epsilon) / paths
+                    + smoother<Rdouble>(lower - runningSpot, -(anchor - runningSpot), 0.0, epsilon) / paths;
+                payoffs.push_back(res.get_slot());
+                break;
+            }
+            prod_step++;
+        }
+    }
+    const Replay_tape::slot_t output = res.get_slot();
+
+    // Monte Carlo simulation
+    // Loop over paths
+    double price = 0;
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
+
+        program.replay(z);
+        for (auto payoff : payoffs) price += program.value(payoff);
+        program.reverse(output);
+    }
+
+    // Adjoints of spot, rate, surface, ... and propagate the rest of the way 
+    program.flush_adjoints();
+    Tdouble::set_mark();
+    Tdouble::propagate_from_mark_to_start();
+    return price;
+}
+
+// Multithreaded MC_Auto_Callable_AAD (see Parallel.hpp), as MC_European_CallOption_Parallel_AAD
+template<typename Make_rng>
+double MC_Auto_Callable_Parallel_AAD(
+    const Tdouble& spot,
+    const Tdouble& rate,
+    const Tdouble& divs,
+    const Tdouble& coupon,
+    const Tdouble& upper, 
+    const Tdouble& lower, 
+    const Tdouble& anchor, 
+    const std::vector<double>& times,
+    Surface_results<Tdouble>& surface, 
+    Make_rng make_rng, 
+    const size_t& paths,
+    const double epsilon,
+    const Parallel_settings& settings = Parallel_settings())
+{
+    return parallel_AAD({&spot, &rate, &divs, &coupon, &upper, &lower, &anchor}, surface,
+        [&times, epsilon](std::vector<Tdouble>& x, Surface_results<Tdouble>& local_surface, RNG::RNG_base& rng, const size_t n)
+        {
+            return MC_Auto_Callable_AAD(x[0], x[1], x[2], x[3], x[4], x[5], x[6], times, local_surface, rng, n, epsilon);
+        },
+        make_rng, paths, settings);
+}
+
+// Auto callable with binomial checkpointing of the time steps (see Checkpoint.hpp).
+// The per path tape is bounded by the budget instead of growing with the number of steps.
+// Path state: running spot, alive and the payoff accumulated over the exercise dates,
+// so all coupons are propagated (not only the last one).
+double MC_Auto_Callable_Checkpointed_AAD(
+    const Tdouble& spot,
+    const Tdouble& rate,
+    const Tdouble& divs,
+    const Tdouble& coupon,
+    const Tdouble& upper, 
+    const Tdouble& lower, 
+    const Tdouble& anchor, 
+    const std::vector<double>& times,
+    Surface_results<Tdouble>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths,
+    const double epsilon,
+    const Checkpoint_budget& budget)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, times);
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // Products step (1, 2, ...) of each exercise step, the loop ends at the last one
+    std::vector<size_t> prod_step(steps, 0);
+    size_t n_steps = steps;
+    for (size_t j = 0, k = 1; j < steps; ++j)
+    {
+        if (!prod_steps[j]) continue;
+        prod_step[j] = k;
+        if (k++ == times.size()) {n_steps = j + 1; break;}
+    }
+
+    // Monte Carlo simulation
+    // Loop over paths
+    Tdouble mu = rate - divs;
+    double price = 0;
+
+    // gaussians of the current path
+    const double* z = nullptr;
+
+    // One time step of the path state {running spot, alive, payoff}
+    auto step = [&](std::array<Tdouble, 3>& state, const size_t j)
+    {
+        Tdouble& runningSpot = state[0];
+        Tdouble& alive       = state[1];
+        Tdouble& payoff      = state[2];
+
+        // Simulate dynamics. Local vol log-Euler step, one node on tape (see Fused.hpp).
+        runningSpot = local_vol_step(surface.spots, surface.lVol[j], runningSpot, mu, dts[j], z[j]);
+
+        // Exercise ?
+        if (!prod_step[j]) return;
+        if (prod_step[j] != times.size())
+        {
+            payoff += alive * smoother<Tdouble>(runningSpot - upper, prod_step[j] * coupon, 0.0, epsilon) / paths;
+            alive   = alive * smoother<Tdouble>(runningSpot - upper, 0, 1, epsilon);
+        }
+        else
+        {
+            payoff += alive * smoother<Tdouble>(runningSpot - upper, prod_step[j] * coupon, 0.0, epsilon) / paths
+                    + smoother<Tdouble>(lower - runningSpot, -(anchor - runningSpot), 0.0, epsilon) / paths;
+        }
+    };
+
+    Tdouble::set_mark();
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        z = &gaussians[(i % block) * steps];
+
+        std::array<Tdouble, 3> state = {spot, 1.0, 0.0};
+        price += checkpointed_loop(state, n_steps, step, 2, budget);
+        Tdouble::set_to_mark();
+    }
+    // Propagate to start
+    Tdouble::propagate_from_mark_to_start();
+
+    return price;
+}
+
+// Hand written adjoint of the auto callable without tape (see Adjoint.hpp), the adjoints of the price
+// (the sum over the exercise dates) as MC_Auto_Callable_Checkpointed_AAD.
+// Returns the price, the adjoints are written to adjoints (lVol as Get_adjoints_SR).
+double MC_Auto_Callable_Adjoint(
+    const double& spot,
+    const double& rate,
+    const double& divs,
+    const double& coupon,
+    const double& upper, 
+    const double& lower, 
+    const double& anchor, 
+    const std::vector<double>& times,
+    Surface_results<double>& surface, 
+    RNG::RNG_base& some_rng, 
+    const size_t& paths,
+    const double epsilon,
+    MC_adjoints& adjoints)
+{
+    // Get timeline from surface (incorporates the products key times)
+    auto timeline = surface.mats;
+    size_t steps = timeline.size();
+
+    // gaussians of blocks of paths, drawn in bulk
+    const size_t block = 256;
+    std::vector<double> 
+        gaussians(block * steps),
+        dts(steps);
+    some_rng.init(steps);
+
+    // Reverse timeline for dts 
+    if (steps > 1) if (timeline[0] > timeline[1]) std::reverse(timeline.begin(), timeline.end());
+    // find common steps (mat for european) 
+    auto prod_steps = CommomValues(timeline, times);
+
+    // Set dts 
+    dts[0] = timeline[0];
+    for (size_t i = 1; i < steps; ++i)
+        { dts[i] = timeline[i] - timeline[i - 1]; }
+
+    // Products step (1, 2, ...) of each exercise step, the loop ends at the last one
+    std::vector<size_t> prod_step(steps, 0);
+    size_t n_steps = steps;
+    for (size_t j = 0, k = 1; j < steps; ++j)
+    {
+        if (!prod_steps[j]) continue;
+        prod_step[j] = k;
+        if (k++ == times.size()) {n_steps = j + 1; break;}
+    }
+
+    adjoints = MC_adjoints();
+    adjoints.lVol = Matrix<double>(surface.lVol.get_rows(), surface.lVol.get_cols());
+
+    // Monte Carlo simulation
+    // Loop over paths
+    const double mu = rate - divs;
+    double price = 0, mu_adjoint = 0;
+    Local_vol_path path(surface.spots, steps);
+    // per exercise step: alive before it, coupon smoother and alive smoother with their partials
+    std::vector<double> 
+        spot_adjoints(steps, 0.),
+        alives(steps), pay(steps), pay_dx(steps), pay_dpos(steps), smooth(steps), smooth_dx(steps);
+    double dpos, dneg;
+    for (size_t i = 0; i < paths; ++i)
+    {
+        // Get new gaussians numbers
+        if (i % block == 0) some_rng.nextG_block(gaussians.data(), std::min(block, paths - i));
+        const double* z = &gaussians[(i % block) * steps];
+        path.simulate(spot, surface.lVol, mu, dts, z, n_steps);
+
+        double alive = 1.0;
+        for (size_t j = 0; j < n_steps; ++j)
+        {
+            if (!prod_step[j]) continue;
+            const double s = path.spot(j);
+            alives[j] = alive;
+            pay[j]    = smoother_adjoint(s - upper, prod_step[j] * coupon, 0.0, epsilon, pay_dx[j], pay_dpos[j], dneg);
+            price    += alive * pay[j] / paths;
+            if (prod_step[j] != times.size())
+            {
+                smooth[j] = smoother_adjoint(s - upper, 0, 1, epsilon, smooth_dx[j], dpos, dneg);
+                alive     = alive * smooth[j];
+            }
+            else
+            {
+                // the put leg at the last date
+                double put_dx, put_dpos;
+                price += smoother_adjoint(lower - s, -(anchor - s), 0.0, epsilon, put_dx, put_dpos, dneg) / paths;
+                spot_adjoints[j] += (put_dpos - put_dx) / paths;
+                adjoints.lower   += put_dx / paths;
+                adjoints.anchor  -= put_dpos / paths;
+            }
+        }
+
+        // back through the exercise dates, alive_adjoint is the adjoint of alive after step j
+        double alive_adjoint = 0.;
+        for (size_t j = n_steps; j-- > 0;)
+        {
+            if (!prod_step[j]) continue;
+            double x_adjoint = alives[j] * pay_dx[j] / paths;
+            adjoints.coupon += alives[j] * pay_dpos[j] * prod_step[j] / paths;
+            if (prod_step[j] != times.size())
+            {
+                x_adjoint    += alive_adjoint * alives[j] * smooth_dx[j];
+                alive_adjoint = alive_adjoint * smooth[j];
+            }
+            alive_adjoint += pay[j] / paths;
+            spot_adjoints[j] += x_adjoint;
+            adjoints.upper   -= x_adjoint;
+        }
+        adjoints.spot += path.reverse(spot_adjoints, surface.lVol, dts, z, adjoints.lVol, mu_adjoint);
+        std::fill(spot_adjoints.begin(), spot_adjoints.end(), 0.);
+    }
+    adjoints.rate =  mu_adjoint;
+    adjoints.divs = -mu_adjoint;
+
+    return price;
+}
+
+#endif
\ No newline at end of file
@@ -3,7 +3,6 @@
 #include "Tdouble.hpp"
 #include "Seq.hpp"
 #include "interp.hpp"
-#include "Node.hpp"
 #include "BS.hpp"
 #include <iomanip>
 #include "Bates_cf.hpp"
@@ -87,6 +86,7 @@ int main()
     Tdouble::tape->clear();
     Tdouble 
         Tspot = spot, Tstrike = strike, Tr = r, Tq = q, Tmat = mat;
+    for (Tdouble* input : {&Tspot, &Tstrike, &Tr, &Tq, &Tmat}) input->put_on_tape();
 
     auto  Tsurf_call = Convert_to_Tdouble(surface);
     
@@ -1,60 +1,67 @@
 #ifndef MODEL_HPP
 #define MODEL_HPP
 
+#include <vector>
 #include "BS.hpp"
 
+// Models are templated on the number type T of their parameters. With T = Tdouble the parameters are
+// inputs on tape and prices, implied and local vols are recorded (see Generate_surface in Surface.hpp).
+template<typename T = double>
 class Model
 {
 protected:
     // holds spot for implied vol formula.
-    const double S;
+    const T S;
 public:
-    Model(double S_) : S(S_) {}
+    Model(const T S_) : S(S_) {}
     // Must be implemented by derived call. Returns a EUR call price.
-    virtual double call(double strike, double mat) = 0;
+    virtual T call(double strike, double mat) = 0;
+    // Must be implemented by derived call. Returns the model parameters, spot included.
+    virtual std::vector<const T*> parameters() const = 0;
     // Returns the implied volatility under some derived model.
-    double iVol(double strike, double mat)
+    T iVol(double strike, double mat)
     {
         // if call_price = 0 or intrisic do something!
-        double call_price = call(strike, mat);
+        T call_price = call(strike, mat);
         return Black_Scholes_Ivol(S, strike, call_price, mat);
     }
 
     // calculates Dupires formula using FD to estimat derivaties.
-    double Dupires_LV(double strike, double mat)
+    T Dupires_LV(double strike, double mat)
     {
         const double tol = 0.0001;
         // simple FD find call_T
-        const double call_T = (call(strike, mat + tol) - call(strike, mat - tol)) * 1./(2. * tol);
+        const T call_T = (call(strike, mat + tol) - call(strike, mat - tol)) * 1./(2. * tol);
         // simple DF find call_KK
-        const double call_KK = (call(strike - tol, mat) + call(strike + tol, mat) - 2. * call(strike, mat)) * 1./(tol * tol);
+        const T call_KK = (call(strike - tol, mat) + call(strike + tol, mat) - 2. * call(strike, mat)) * 1./(tol * tol);
 
         // Dupires formula
         return sqrt(2. * call_T / call_KK) / strike;
     }
 
-    double Spot(){return S;}
+    double Spot(){return double(S);}
 };
 
 #include "Bates_cf.hpp"
 
-class Bates : public Model
+template<typename T = double>
+class Bates : public Model<T>
 {
-    const double r, q, v0, vT, rho, kappa, sigma, intens, jump_mean, jump_std;
+    const T r, q, v0, vT, rho, kappa, sigma, intens, jump_mean, jump_std;
 
     public:
-    Bates(const double S_,
-        const double r_,
-        const double q_,
-        const double v0_,
-        const double vT_,
-        const double rho_,
-        const double kappa_,
-        const double sigma_,
-        const double intens_,
-        const double jump_mean_,
-        const double jump_std_)
-        : Model(S_),
+    Bates(const T S_,
+        const T r_,
+        const T q_,
+        const T v0_,
+        const T vT_,
+        const T rho_,
+        const T kappa_,
+        const T sigma_,
+        const T intens_,
+        const T jump_mean_,
+        const T jump_std_)
+        : Model<T>(S_),
         r(r_),
         q(q_),
         v0(v0_),
@@ -67,9 +74,14 @@ class Bates : public Model
         jump_std(jump_std_)
         {}
 
-        double call(double strike, double mat) override
+        T call(double strike, double mat) override
         {
-            return Batescf_call(S, strike, mat, r, q, v0, vT, rho, kappa, sigma, intens, jump_mean, jump_mean);
+            return Batescf_call(this->S, strike, mat, r, q, v0, vT, rho, kappa, sigma, intens, jump_mean, jump_std);
+        }
+
+        std::vector<const T*> parameters() const override
+        {
+            return {&this->S, &r, &q, &v0, &vT, &rho, &kappa, &sigma, &intens, &jump_mean, &jump_std};
         }
 };
 #endif
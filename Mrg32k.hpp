@@ -1,119 +1,226 @@
-#pragma once
-#include<vector>
-#include<cassert>
-#include "RNG_base.hpp"
-#include "Gaussian.hpp"
-
-namespace RNG
-{
-	class Mrg32k_RNG : public RNG::RNG_base
-	{
-		size_t my_dim;
-
-		// members 
-		const double my_alpha, my_beta;
-		double x0, x1, x2;
-		double y0, y1, y2;
-
-		// reuse randoms=
-		bool my_anti = false;
-
-		
-		std::vector<double> my_unif;
-		std::vector<double> my_gaus;
-
-		//  Constants
-		static constexpr double	m1 = 4294967087; //(2^32 - 209)
-		static constexpr double	m2 = 4294944443; //(2^32 - 28532)
-
-		// a1 vector 
-		static constexpr double	a10 = 0;
-		static constexpr double	a11 = 1403580;
-		static constexpr double	a12 = 810728;
-		// a2 vector
-		static constexpr double	a20 = 527612;
-		static constexpr double	a21 = 0;
-		static constexpr double	a22 = 1370589;
-
-		static constexpr double my_max = 4294967088;
-
-		double next_unif()
-		{
-			double x = a11 * x1 + a12 * x2;
-			x -= int((x / m1))*m1;
-			x0 = x;
-			x1 = x0;
-			x2 = x1;
-
-			double y = a20 * y0 + a22 * y2;
-			y -= int(y / m1) * m1;
-			y0 = y;
-			y1 = y0;
-			y2 = y1;
-		
-			return x > y ? 
-				(x - y) / my_max : 
-				(x - y + m1) / my_max;
-		}
-
-	public:
-		Mrg32k_RNG(const unsigned A = 12345, const unsigned B = 54321): my_alpha(A), my_beta(B)
-		{
-			assert(A < m1 && B < m2);
-			reset_members();
-		}
-
-		~Mrg32k_RNG()
-		{
-		}
-
-		void init(const size_t simDim) override
-		{
-			my_dim = simDim;
-			my_unif.resize(my_dim);
-			my_gaus.resize(my_dim);
-		}
-		void reset_members() override
-		{
-			x0 = x1 = x2 = my_alpha;
-			y0 = y1 = y2 = my_beta;
-			my_anti = false;
-		}
-
-		void nextU(std::vector<double>& uVec) override
-		{
-			if (my_anti)
-			{
-				std::transform(my_unif.begin(), my_unif.end(), my_unif.begin(), [](const double entry)
-				{return 1 - entry;});
-
-				my_anti = false;
-				uVec = my_unif;
-				return;
-			}
-			else
-			{
-				std::generate(uVec.begin(), uVec.end(), [this]()
-				{return next_unif();});
-
-				my_anti = true;
-				my_unif = uVec;
-			}
-		};
-
-		virtual void nextG(std::vector<double>& gVec) override
-		{
-			if(my_anti)
-				{
-					std::transform(gVec.begin(), gVec.end(), gVec.begin(), [] (const double entry)
-					{return -entry;});
-					my_anti = false;
-				}
-				else
-				{
-					std::generate(gVec.begin(), gVec.end(), [this](){return gaussian::invNormalCdf(next_unif());});
-					my_anti = true;
-				}
-		};
-	};
-}
+#pragma once
+#include<vector>
+#include<array>
+#include<cstdint>
+#include<cassert>
+#include "RNG_base.hpp"
+#include "Gaussian.hpp"
+
+namespace RNG
+{
+	// MRG32k3a of L'Ecuyer (1999) in 64 bit integers, bit-exact against the reference implementation
+	// (seeds 12345 for all six state words give 0.1270111220, 0.3185275654, 0.3091860156, ...).
+	// skip_ahead(n) jumps n uniforms ahead in O(log n) with the powers A^(2^i) of the transition matrices.
+	// stream(s, u) starts at substream u of stream s as in RngStreams (L'Ecuyer et al. 2002):
+	// streams are 2^127 uniforms apart and substreams 2^76, e.g. one substream per chunk of paths.
+	class Mrg32k_RNG : public RNG::RNG_base
+	{
+	public:
+		using state_t  = std::array<std::int64_t, 3>;
+		using matrix_t = std::array<state_t, 3>;
+
+	private:
+		size_t my_dim;
+
+		// members
+		const double my_alpha, my_beta;
+		// last three values of each component, oldest first, and the state reset_members() returns to
+		state_t my_x, my_y;
+		state_t my_x_start, my_y_start;
+
+		// reuse randoms=
+		bool my_anti = false;
+
+
+		std::vector<double> my_unif;
+		std::vector<double> my_gaus;
+
+		//  Constants
+		static constexpr std::int64_t	m1 = 4294967087; //(2^32 - 209)
+		static constexpr std::int64_t	m2 = 4294944443; //(2^32 - 28532)
+
+		// x_n = (a12 * x_n-2 - a13 * x_n-3) mod m1
+		static constexpr std::int64_t	a12 = 1403580;
+		static constexpr std::int64_t	a13 = 810728;
+		// y_n = (a21 * y_n-1 - a23 * y_n-3) mod m2
+		static constexpr std::int64_t	a21 = 527612;
+		static constexpr std::int64_t	a23 = 1370589;
+
+		// 1 / (m1 + 1)
+		static constexpr double my_norm = 2.328306549295727688e-10;
+
+		// next n uniforms, the state in registers
+		void next_unifs(double* res, const size_t n)
+		{
+			std::int64_t x0 = my_x[0], x1 = my_x[1], x2 = my_x[2];
+			std::int64_t y0 = my_y[0], y1 = my_y[1], y2 = my_y[2];
+			for (size_t i = 0; i < n; ++i)
+			{
+				std::int64_t x = (a12 * x1 - a13 * x0) % m1;
+				x += x < 0 ? m1 : 0;
+				x0 = x1; x1 = x2; x2 = x;
+
+				std::int64_t y = (a21 * y2 - a23 * y0) % m2;
+				y += y < 0 ? m2 : 0;
+				y0 = y1; y1 = y2; y2 = y;
+
+				res[i] = (x > y ? x - y : x - y + m1) * my_norm;
+			}
+			my_x = {x0, x1, x2};
+			my_y = {y0, y1, y2};
+		}
+
+		// ---------------------------------------------------------------
+		// - SKIP AHEAD
+		// ---------------------------------------------------------------
+		static matrix_t mult(const matrix_t& a, const matrix_t& b, const std::int64_t m)
+		{
+			matrix_t res;
+			for (size_t i = 0; i < 3; ++i)
+				for (size_t j = 0; j < 3; ++j)
+				{
+					// entries are below 2^32, each product fits in 64 bits
+					std::uint64_t sum = 0;
+					for (size_t k = 0; k < 3; ++k) sum += std::uint64_t(a[i][k]) * std::uint64_t(b[k][j]) % std::uint64_t(m);
+					res[i][j] = std::int64_t(sum % std::uint64_t(m));
+				}
+			return res;
+		}
+
+		static void apply(const matrix_t& a, state_t& s, const std::int64_t m)
+		{
+			state_t res;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				std::uint64_t sum = 0;
+				for (size_t k = 0; k < 3; ++k) sum += std::uint64_t(a[i][k]) * std::uint64_t(s[k]) % std::uint64_t(m);
+				res[i] = std::int64_t(sum % std::uint64_t(m));
+			}
+			s = res;
+		}
+
+		// A^(2^i) for i < 192 (the period is about 2^191), computed once
+		struct Powers
+		{
+			std::array<matrix_t, 192> x, y;
+			Powers()
+			{
+				x[0] = {{{0, 1, 0}, {0, 0, 1}, {m1 - a13, a12, 0}}};
+				y[0] = {{{0, 1, 0}, {0, 0, 1}, {m2 - a23, 0, a21}}};
+				for (size_t i = 1; i < x.size(); ++i)
+				{
+					x[i] = mult(x[i - 1], x[i - 1], m1);
+					y[i] = mult(y[i - 1], y[i - 1], m2);
+				}
+			}
+		};
+
+		static const Powers& powers()
+		{
+			static const Powers table;
+			return table;
+		}
+
+		// jumps count * 2^e uniforms ahead
+		void jump(std::uint64_t count, size_t e)
+		{
+			const Powers& table = powers();
+			for (; count; count >>= 1, ++e)
+			{
+				if (!(count & 1)) continue;
+				if (e >= table.x.size()) std::__throw_runtime_error("Mrg32k_RNG: jump beyond the period");
+				apply(table.x[e], my_x, m1);
+				apply(table.y[e], my_y, m2);
+			}
+		}
+
+	public:
+		Mrg32k_RNG(const unsigned A = 12345, const unsigned B = 54321): my_alpha(A), my_beta(B)
+		{
+			assert(A < m1 && B < m2);
+			my_x_start = {A, A, A};
+			my_y_start = {B, B, B};
+			reset_members();
+		}
+
+		~Mrg32k_RNG()
+		{
+		}
+
+		// Generator at the start of substream 'substream' of stream 'stream'
+		static Mrg32k_RNG stream(const size_t stream, const size_t substream = 0, const unsigned A = 12345, const unsigned B = 54321)
+		{
+			Mrg32k_RNG res(A, B);
+			res.jump(stream, 127);
+			res.jump(substream, 76);
+			res.my_x_start = res.my_x;
+			res.my_y_start = res.my_y;
+			return res;
+		}
+
+		// Skips the next n uniforms (n * dim for n vectors), the next vector is drawn, not antithetic
+		void skip_ahead(const std::uint64_t n)
+		{
+			jump(n, 0);
+			my_anti = false;
+		}
+
+		void init(const size_t simDim) override
+		{
+			my_dim = simDim;
+			my_unif.resize(my_dim);
+			my_gaus.resize(my_dim);
+		}
+		void reset_members() override
+		{
+			my_x = my_x_start;
+			my_y = my_y_start;
+			my_anti = false;
+		}
+
+		void nextU(std::vector<double>& uVec) override
+		{
+			nextU_block(uVec.data(), 1);
+		};
+
+		virtual void nextG(std::vector<double>& gVec) override
+		{
+			nextG_block(gVec.data(), 1);
+		};
+
+		// Antithetic rows mirror the row before them (my_unif / my_gaus across calls)
+		void nextU_block(double* uniforms, const size_t n) override
+		{
+			draw(uniforms, n, my_unif, [](double*, const size_t) {}, [](const double entry) {return 1 - entry;});
+		}
+
+		void nextG_block(double* gaussians, const size_t n) override
+		{
+			draw(gaussians, n, my_gaus, [](double* row, const size_t dim) {gaussian::invNormalCdf(row, row, dim);},
+				[](const double entry) {return -entry;});
+		}
+
+	private:
+		template<typename Transform, typename Mirror>
+		void draw(double* rows, const size_t n, std::vector<double>& last, Transform transform, Mirror mirror)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				double* row = rows + i * my_dim;
+				if (my_anti)
+				{
+					const double* drawn = i ? row - my_dim : last.data();
+					for (size_t k = 0; k < my_dim; ++k) row[k] = mirror(drawn[k]);
+				}
+				else
+				{
+					next_unifs(row, my_dim);
+					transform(row, my_dim);
+				}
+				my_anti = !my_anti;
+			}
+			// the mirror of the last row comes with the next call
+			if (n && my_anti) std::copy(rows + (n - 1) * my_dim, rows + n * my_dim, last.begin());
+		}
+	};
+}
@@ -0,0 +1,187 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+// STL includes
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+
+// user includes
+#include "Tdouble.hpp"
+#include "Surface.hpp"
+#include "RNG_base.hpp"
+
+// Multithreaded AAD Monte Carlo.
+// Tdouble::tape is thread local, so each worker records on its own Tape. The paths are split in chunks of
+// chunk_paths paths, each priced by a single threaded AAD pricer on the worker's tape, with leaves holding
+// the values of the scalar inputs and the local vol surface, and its own RNG make_rng(chunk).
+// The price and the input adjoints of each chunk are kept and summed in chunk order at the end, so the
+// results are bit-identical for any number of threads (for a given chunk_paths).
+// The summed adjoints are added to the inputs on the calling thread's tape and propagated from there.
+// parallel_MC() is the same loop for the double pricers, without tapes.
+// Antithetic pairs (see Mrg32k.hpp) stay within a chunk when chunk_paths is even.
+struct Parallel_settings
+{
+    size_t threads     = std::max<size_t>(1, std::thread::hardware_concurrency());
+    size_t chunk_paths = 4096;
+};
+
+// pricer(scalars, surface, rng, paths) prices paths paths on the worker's tape and returns the price
+// with the payoffs divided by paths, as the AAD pricers of MC.hpp. Its adjoints are left on the leaves.
+template<typename Pricer, typename Make_rng>
+double parallel_AAD(
+    const std::vector<const Tdouble*>& scalars,
+    Surface_results<Tdouble>& surface,
+    Pricer pricer,
+    Make_rng make_rng,
+    const size_t paths,
+    const Parallel_settings& settings = Parallel_settings())
+{
+    const size_t threads     = std::max<size_t>(1, settings.threads);
+    const size_t chunk_paths = std::max<size_t>(1, settings.chunk_paths);
+    const size_t n_chunks    = (paths + chunk_paths - 1) / chunk_paths;
+    const size_t n_scalars   = scalars.size();
+    const size_t n_adjoints  = n_scalars + surface.lVol.get_rows() * surface.lVol.get_cols();
+
+    // price and adjoints of each chunk, scaled to the chunk's share of paths
+    std::vector<double>              prices(n_chunks);
+    std::vector<std::vector<double>> adjoints(n_chunks);
+
+    std::atomic<size_t>     next_chunk(0);
+    std::vector<std::exception_ptr> errors(threads);
+
+    auto worker = [&](const size_t thread)
+    {
+        try
+        {
+            Tape tape;
+            Tdouble::tape = &tape;
+
+            // inputs of the worker, leaves on its tape for every chunk
+            std::vector<Tdouble> local_scalars(n_scalars);
+            Surface_results<Tdouble> local_surface = surface;
+            for (auto& vol : local_surface.iVol) vol = vol.get_value();
+
+            for (size_t chunk = next_chunk++; chunk < n_chunks; chunk = next_chunk++)
+            {
+                tape.clear();
+                for (size_t k = 0; k < n_scalars; ++k)
+                {
+                    local_scalars[k] = scalars[k]->get_value();
+                    local_scalars[k].put_on_tape();
+                }
+                for (auto& vol : local_surface.lVol) {vol = vol.get_value(); vol.put_on_tape();}
+
+                const size_t chunk_size = std::min(chunk_paths, paths - chunk * chunk_paths);
+                const double weight     = double(chunk_size) / double(paths);
+                auto rng = make_rng(chunk);
+                prices[chunk] = pricer(local_scalars, local_surface, rng, chunk_size) * weight;
+
+                std::vector<double>& res = adjoints[chunk];
+                res.resize(n_adjoints);
+                for (size_t k = 0; k < n_scalars; ++k) res[k] = local_scalars[k].get_adjoint() * weight;
+                size_t k = n_scalars;
+                for (auto& vol : local_surface.lVol) res[k++] = vol.get_adjoint() * weight;
+            }
+        }
+        catch (...)
+        {
+            errors[thread] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; ++thread) workers.emplace_back(worker, thread);
+    {
+        // the calling thread works too, on its own tape
+        Tape* caller_tape = Tdouble::tape;
+        worker(0);
+        Tdouble::tape = caller_tape;
+    }
+    for (auto& thread : workers) thread.join();
+    for (auto& error : errors) if (error) std::rethrow_exception(error);
+
+    // Reduction in chunk order
+    double price = 0;
+    std::vector<double> sum(n_adjoints, 0.);
+    for (size_t chunk = 0; chunk < n_chunks; ++chunk)
+    {
+        price += prices[chunk];
+        for (size_t k = 0; k < n_adjoints; ++k) sum[k] += adjoints[chunk][k];
+    }
+
+    // Adjoints of the inputs on the caller's tape, propagated to start
+    size_t last = 0;
+    bool active = false;
+    for (size_t k = 0; k < n_scalars; ++k)
+    {
+        if (!scalars[k]->is_active()) continue;
+        scalars[k]->get_adjoint() += sum[k];
+        last   = std::max<size_t>(last, scalars[k]->get_index());
+        active = true;
+    }
+    size_t k = n_scalars;
+    for (auto& vol : surface.lVol)
+    {
+        if (vol.is_active())
+        {
+            vol.get_adjoint() += sum[k];
+            last   = std::max<size_t>(last, vol.get_index());
+            active = true;
+        }
+        ++k;
+    }
+    if (active) Tdouble::tape->propagate(last, 0);
+
+    return price;
+}
+
+// pricer(rng, paths) prices paths paths with rng and returns their average, as the double pricers of MC.hpp.
+// The chunk prices are weighted by their share of paths and summed in chunk order.
+template<typename Pricer, typename Make_rng>
+double parallel_MC(
+    Pricer pricer,
+    Make_rng make_rng,
+    const size_t paths,
+    const Parallel_settings& settings = Parallel_settings())
+{
+    const size_t threads     = std::max<size_t>(1, settings.threads);
+    const size_t chunk_paths = std::max<size_t>(1, settings.chunk_paths);
+    const size_t n_chunks    = (paths + chunk_paths - 1) / chunk_paths;
+
+    std::vector<double>             prices(n_chunks);
+    std::atomic<size_t>             next_chunk(0);
+    std::vector<std::exception_ptr> errors(threads);
+
+    auto worker = [&](const size_t thread)
+    {
+        try
+        {
+            for (size_t chunk = next_chunk++; chunk < n_chunks; chunk = next_chunk++)
+            {
+                const size_t chunk_size = std::min(chunk_paths, paths - chunk * chunk_paths);
+                auto rng = make_rng(chunk);
+                prices[chunk] = pricer(rng, chunk_size) * (double(chunk_size) / double(paths));
+            }
+        }
+        catch (...)
+        {
+            errors[thread] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; ++thread) workers.emplace_back(worker, thread);
+    worker(0);
+    for (auto& thread : workers) thread.join();
+    for (auto& error : errors) if (error) std::rethrow_exception(error);
+
+    // Reduction in chunk order
+    double price = 0;
+    for (const double chunk_price : prices) price += chunk_price;
+    return price;
+}
+
+#endif
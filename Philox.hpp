@@ -0,0 +1,154 @@
+#ifndef PHILOX_HPP
+#define PHILOX_HPP
+
+// STL includes
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+
+// user includes
+#include "RNG_base.hpp"
+#include "Gaussian.hpp"
+
+namespace RNG
+{
+    // Counter based Philox-4x32-10 (Salmon et al., Parallel random numbers: as easy as 1, 2, 3, 2011).
+    // The uniform of (path, step) is a pure function of the key: word step % 4 of the block of counter
+    // (step / 4, 0, path low, path high), as (x + 0.5) / 2^32. No state but the next path, no antithetics:
+    // any path can be regenerated alone (uniform(), gaussian()), chunks of a parallel run need no
+    // positioned copies (Philox_RNG(key, first path of the chunk)) and shards only share the key.
+    // The block generator runs the rounds on 8 counters at once in plain loops over the lanes, which the
+    // compiler vectorises (32 x 32 -> 64 bit multiplies).
+    class Philox_RNG : public RNG_base
+    {
+    public:
+        using counter_t = std::array<std::uint32_t, 4>;
+        using key_t     = std::array<std::uint32_t, 2>;
+
+    private:
+        size_t              my_dim = 0;
+        const key_t         my_key;
+        const std::uint64_t my_first;
+        std::uint64_t       my_path;
+
+        static constexpr std::uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+        static constexpr std::uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+        static constexpr double my_norm = 1. / 4294967296.;
+        static constexpr size_t lanes = 8;
+
+        // 10 rounds on lanes counters (x0, x1, x2, x3) with the same key
+        static void rounds(std::uint32_t* x0, std::uint32_t* x1, std::uint32_t* x2, std::uint32_t* x3, key_t key)
+        {
+            for (size_t round = 0; round < 10; ++round)
+            {
+                for (size_t i = 0; i < lanes; ++i)
+                {
+                    const std::uint64_t p0 = std::uint64_t(M0) * x0[i];
+                    const std::uint64_t p1 = std::uint64_t(M1) * x2[i];
+                    const std::uint32_t y0 = std::uint32_t(p1 >> 32) ^ x1[i] ^ key[0];
+                    const std::uint32_t y2 = std::uint32_t(p0 >> 32) ^ x3[i] ^ key[1];
+                    x1[i] = std::uint32_t(p1);
+                    x3[i] = std::uint32_t(p0);
+                    x0[i] = y0;
+                    x2[i] = y2;
+                }
+                key[0] += W0;
+                key[1] += W1;
+            }
+        }
+
+    public:
+        // key of the streams, first path drawn (and after reset_members())
+        Philox_RNG(const std::uint64_t key = 0, const std::uint64_t first = 0)
+            : my_key({std::uint32_t(key), std::uint32_t(key >> 32)}), my_first(first), my_path(first) {}
+
+        // Philox-4x32-10 of one counter
+        static counter_t philox(const counter_t& counter, const key_t& key)
+        {
+            std::uint32_t x[4][lanes] = {};
+            for (size_t k = 0; k < 4; ++k) x[k][0] = counter[k];
+            rounds(x[0], x[1], x[2], x[3], key);
+            return {x[0][0], x[1][0], x[2][0], x[3][0]};
+        }
+
+        double uniform(const std::uint64_t path, const size_t step) const
+        {
+            const counter_t block = philox({std::uint32_t(step / 4), 0, std::uint32_t(path), std::uint32_t(path >> 32)}, my_key);
+            return (block[step % 4] + 0.5) * my_norm;
+        }
+
+        double gaussian(const std::uint64_t path, const size_t step) const
+        {
+            return gaussian::invNormalCdf(uniform(path, step));
+        }
+
+        // Next vector is path n
+        void skip_ahead(const std::uint64_t n) {my_path = n;}
+
+        void init(const size_t simDim) override {my_dim = simDim;}
+
+        void reset_members() override {my_path = my_first;}
+
+        void nextU(std::vector<double>& uVec) override
+        {
+            nextU_block(uVec.data(), 1);
+        }
+
+        void nextG(std::vector<double>& gVec) override
+        {
+            nextG_block(gVec.data(), 1);
+        }
+
+        void nextU_block(double* uniforms, const size_t n) override
+        {
+            // counters of the block: path (row) by path, step / 4 within a path, the lanes past the end are
+            // computed and dropped
+            const size_t per_path = (my_dim + 3) / 4;
+            const size_t counters = n * per_path;
+            std::uint32_t x0[lanes], x1[lanes], x2[lanes], x3[lanes];
+            size_t row = 0, block = 0;
+            for (size_t first = 0; first < counters; first += lanes)
+            {
+                for (size_t i = 0, r = row, b = block; i < lanes; ++i)
+                {
+                    const std::uint64_t path = my_path + r;
+                    x0[i] = std::uint32_t(b);
+                    x1[i] = 0;
+                    x2[i] = std::uint32_t(path);
+                    x3[i] = std::uint32_t(path >> 32);
+                    if (++b == per_path) {b = 0; ++r;}
+                }
+                rounds(x0, x1, x2, x3, my_key);
+
+                for (size_t i = 0; i < lanes && first + i < counters; ++i)
+                {
+                    const size_t step = 4 * block;
+                    double* u = uniforms + row * my_dim + step;
+                    if (step + 4 <= my_dim)
+                    {
+                        u[0] = (x0[i] + 0.5) * my_norm;
+                        u[1] = (x1[i] + 0.5) * my_norm;
+                        u[2] = (x2[i] + 0.5) * my_norm;
+                        u[3] = (x3[i] + 0.5) * my_norm;
+                    }
+                    else
+                    {
+                        const std::uint32_t words[4] = {x0[i], x1[i], x2[i], x3[i]};
+                        for (size_t k = 0; step + k < my_dim; ++k) u[k] = (words[k] + 0.5) * my_norm;
+                    }
+                    if (++block == per_path) {block = 0; ++row;}
+                }
+            }
+            my_path += n;
+        }
+
+        void nextG_block(double* gaussians, const size_t n) override
+        {
+            nextU_block(gaussians, n);
+            gaussian::invNormalCdf(gaussians, gaussians, n * my_dim);
+        }
+    };
+}
+
+#endif
@@ -15,6 +15,11 @@ namespace RNG
         virtual void nextU(std::vector<double>& uVec) = 0;
         virtual void nextG(std::vector<double>& gVed) = 0;
 
+        // n vectors of simDim numbers, row by row in a caller owned buffer of n * simDim doubles,
+        // the same numbers as n calls of nextU / nextG
+        virtual void nextU_block(double* uniforms, const size_t n) = 0;
+        virtual void nextG_block(double* gaussians, const size_t n) = 0;
+
         virtual void reset_members(){}; 
 
     public:
@@ -0,0 +1,502 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+// STL includes
+#include <math.h>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <algorithm>
+
+// user includes
+#include "Tdouble.hpp"
+#include "Gaussian.hpp"
+
+// Record once, replay many.
+// The per path computation of a Monte Carlo pricer is the same sequence of operations on every path, only
+// the path inputs (gaussians) and the data dependent choices (interp bucket, payoff kinks) change.
+// Replay_tape holds that sequence as a program of op codes, recorded once with Rdouble. Each instruction
+// defines one slot (its index). replay() reruns the forward values for new path inputs and reverse()
+// the adjoints, without recording on the Tdouble tape. Adjoints of the parameters (Tdoubles used in the
+// path: spot, rate, surface nodes, ...) are summed over paths and added to the tape by flush_adjoints().
+//
+// Data dependent choices are explicit instructions evaluated at replay: interp (bucket), max, min and
+// select (kinks). Rdouble has no comparison operators, so a C++ branch on a path value does not compile.
+// local_vol_step() is one fused instruction, as local_vol_step() in Fused.hpp on the tape: the interp and
+// the 10 or so operations of a log-Euler step would otherwise be dispatched one by one on every path, and
+// the replay would be no faster than the tape (bench_replay: 5.0-5.8 vs 7.0-7.6 us/path with the fused step).
+namespace replay_ops
+{
+    enum Op : uint8_t
+    {
+        constant, param, input,
+        add, sub, mul, div,
+        add_c, sub_c, c_sub, mul_c, div_c, c_div, pow_c,
+        max, min, neg, exp, log, sqrt, normalCdf,
+        select,     // a > 0 ? b : aux
+        interp,     // interp of slot a on my_interps[aux]
+        lv_step     // local_vol_step of spot a with gaussian b over dt c, mu and row in my_steps[aux]
+    };
+} // namespace replay_ops
+
+struct Replay_instr
+{
+    replay_ops::Op  op;
+    uint32_t        a;
+    uint32_t        b;
+    uint32_t        aux;
+    double          c;
+};
+
+class Replay_tape
+{
+public:
+    using slot_t = uint32_t;
+
+private:
+    struct Interp
+    {
+        const double*   xs;
+        size_t          n;
+        slot_t          y0;     // y values are the slots [y0, y0 + n)
+    };
+
+    struct Step
+    {
+        slot_t          mu;
+        uint32_t        row;    // in my_interps
+    };
+
+    std::vector<Replay_instr>       my_code;
+    std::vector<Interp>             my_interps;
+    std::vector<Step>               my_steps;
+    size_t                          my_n_inputs = 0;
+
+    // Parameters: tape node of each param instruction
+    std::vector<Tape::index_t>      my_param_nodes;
+    std::map<Tape::index_t, slot_t> my_param_slots;
+    std::map<const Tdouble*, slot_t> my_interp_rows;
+
+    // Values and adjoints of the slots, bucket of each interp and lv_step instruction, growth of each lv_step
+    std::vector<double>             my_values;
+    std::vector<double>             my_adjoints;
+    std::vector<uint32_t>           my_buckets;
+    std::vector<double>             my_growths;
+
+    // Instructions depending on the path (all but constants and params), set up by prepare()
+    std::vector<slot_t>             my_path_code;
+    std::vector<slot_t>             my_param_list;
+    size_t                          my_prepared = 0;
+
+    // Values of constants and params are set once, their instructions are not replayed.
+    // Param adjoints are summed in place over paths.
+    void prepare()
+    {
+        const size_t n = my_code.size();
+        my_values.assign(n, 0.);
+        my_adjoints.assign(n, 0.);
+        my_buckets.assign(n, 0);
+        my_growths.assign(n, 0.);
+        my_path_code.clear();
+        my_param_list.clear();
+        for (size_t k = 0; k < n; ++k)
+        {
+            const replay_ops::Op op = my_code[k].op;
+            if (op == replay_ops::constant || op == replay_ops::param) my_values[k] = my_code[k].c;
+            else                                                       my_path_code.push_back(slot_t(k));
+            if (op == replay_ops::param) my_param_list.push_back(slot_t(k));
+        }
+        my_prepared = n;
+    }
+
+public:
+// ---------------------------------------------------------------
+// - RECORDING
+// ---------------------------------------------------------------
+    slot_t emit(const replay_ops::Op op, const slot_t a = 0, const slot_t b = 0, const uint32_t aux = 0, const double c = 0.)
+    {
+        my_code.push_back({op, a, b, aux, c});
+        return slot_t(my_code.size() - 1);
+    }
+
+    // Slot of a Tdouble, the same node gives the same slot. Passive Tdoubles are constants.
+    slot_t param(const Tdouble& x)
+    {
+        if (!x.is_active()) return emit(replay_ops::constant, 0, 0, 0, x.get_value());
+
+        auto it = my_param_slots.find(x.get_index());
+        if (it != my_param_slots.end()) return it->second;
+
+        const slot_t slot = emit(replay_ops::param, 0, 0, uint32_t(my_param_nodes.size()), x.get_value());
+        my_param_nodes.push_back(x.get_index());
+        my_param_slots[x.get_index()] = slot;
+        return slot;
+    }
+
+    // Slot of path input k, its value is given to replay()
+    slot_t input(const size_t k)
+    {
+        my_n_inputs = std::max(my_n_inputs, k + 1);
+        return emit(replay_ops::input, 0, 0, uint32_t(k));
+    }
+
+    // Row of an interpolation on (xs, ys), the ys are params (or constants) the first time
+    uint32_t interp_row(const double* xs, const Tdouble* ys, const size_t n)
+    {
+        auto it = my_interp_rows.find(ys);
+        if (it == my_interp_rows.end())
+        {
+            const slot_t y0 = slot_t(my_code.size());
+            for (size_t i = 0; i < n; ++i)
+            {
+                // each y in its own slot, so the row is contiguous
+                if (ys[i].is_active())
+                {
+                    emit(replay_ops::param, 0, 0, uint32_t(my_param_nodes.size()), ys[i].get_value());
+                    my_param_nodes.push_back(ys[i].get_index());
+                }
+                else
+                {
+                    emit(replay_ops::constant, 0, 0, 0, ys[i].get_value());
+                }
+            }
+            it = my_interp_rows.emplace(ys, uint32_t(my_interps.size())).first;
+            my_interps.push_back({xs, n, y0});
+        }
+        return uint32_t(it->second);
+    }
+
+    // Linear interpolation of x on (xs, ys), as interp() in interp.hpp. The bucket is chosen at replay.
+    slot_t interp(const double* xs, const Tdouble* ys, const size_t n, const slot_t x)
+    {
+        return emit(replay_ops::interp, x, 0, interp_row(xs, ys, n));
+    }
+
+    // Log-Euler step of spot with the vol interpolated on (xs, ys), as local_vol_step() in Fused.hpp
+    slot_t local_vol_step(const double* xs, const Tdouble* ys, const size_t n, const slot_t spot, const slot_t mu,
+        const double dt, const slot_t z)
+    {
+        my_steps.push_back({mu, interp_row(xs, ys, n)});
+        return emit(replay_ops::lv_step, spot, z, uint32_t(my_steps.size() - 1), dt);
+    }
+
+    size_t size()     const {return my_code.size();}
+    size_t n_inputs() const {return my_n_inputs;}
+
+    void clear()
+    {
+        my_code.clear();
+        my_interps.clear();
+        my_steps.clear();
+        my_n_inputs = 0;
+        my_param_nodes.clear();
+        my_param_slots.clear();
+        my_interp_rows.clear();
+        my_prepared = 0;
+    }
+
+// ---------------------------------------------------------------
+// - REPLAY
+// ---------------------------------------------------------------
+    // Forward values of all slots for the path inputs
+    void replay(const double* inputs)
+    {
+        if (my_prepared != my_code.size()) prepare();
+        double* v = my_values.data();
+
+        for (const slot_t k : my_path_code)
+        {
+            const Replay_instr& in = my_code[k];
+            switch (in.op)
+            {
+                case replay_ops::constant:  break;
+                case replay_ops::param:     break;
+                case replay_ops::input:     v[k] = inputs[in.aux]; break;
+                case replay_ops::add:       v[k] = v[in.a] + v[in.b]; break;
+                case replay_ops::sub:       v[k] = v[in.a] - v[in.b]; break;
+                case replay_ops::mul:       v[k] = v[in.a] * v[in.b]; break;
+                case replay_ops::div:       v[k] = v[in.a] / v[in.b]; break;
+                case replay_ops::add_c:     v[k] = v[in.a] + in.c; break;
+                case replay_ops::sub_c:     v[k] = v[in.a] - in.c; break;
+                case replay_ops::c_sub:     v[k] = in.c - v[in.a]; break;
+                case replay_ops::mul_c:     v[k] = v[in.a] * in.c; break;
+                case replay_ops::div_c:     v[k] = v[in.a] / in.c; break;
+                case replay_ops::c_div:     v[k] = in.c / v[in.a]; break;
+                case replay_ops::pow_c:     v[k] = ::pow(v[in.a], in.c); break;
+                case replay_ops::max:       v[k] = v[in.a] > v[in.b] ? v[in.a] : v[in.b]; break;
+                case replay_ops::min:       v[k] = v[in.a] < v[in.b] ? v[in.a] : v[in.b]; break;
+                case replay_ops::neg:       v[k] = -v[in.a]; break;
+                case replay_ops::exp:       v[k] = ::exp(v[in.a]); break;
+                case replay_ops::log:       v[k] = ::log(v[in.a]); break;
+                case replay_ops::sqrt:      v[k] = ::sqrt(v[in.a]); break;
+                case replay_ops::normalCdf: v[k] = gaussian::normalCdf(v[in.a]); break;
+                case replay_ops::select:    v[k] = v[in.a] > 0 ? v[in.b] : v[in.aux]; break;
+                case replay_ops::interp:
+                {
+                    const Interp& ip = my_interps[in.aux];
+                    const double  x  = v[in.a];
+                    const size_t  it = std::upper_bound(ip.xs, ip.xs + ip.n, x) - ip.xs;
+                    my_buckets[k] = uint32_t(it);
+                    if (it == ip.n)     {v[k] = v[ip.y0 + ip.n - 1]; break;}
+                    if (it == 0)        {v[k] = v[ip.y0]; break;}
+                    const double x1 = ip.xs[it - 1], x2 = ip.xs[it];
+                    const double y1 = v[ip.y0 + it - 1], y2 = v[ip.y0 + it];
+                    v[k] = y1 + (y2 - y1) * ((x - x1) / (x2 - x1));
+                    break;
+                }
+                case replay_ops::lv_step:
+                {
+                    const Interp& ip = my_interps[my_steps[in.aux].row];
+                    const double  s  = v[in.a];
+                    const size_t  it = std::upper_bound(ip.xs, ip.xs + ip.n, s) - ip.xs;
+                    my_buckets[k] = uint32_t(it);
+                    double vol;
+                    if (it == ip.n)     vol = v[ip.y0 + ip.n - 1];
+                    else if (it == 0)   vol = v[ip.y0];
+                    else
+                    {
+                        const double x1 = ip.xs[it - 1], x2 = ip.xs[it];
+                        const double y1 = v[ip.y0 + it - 1], y2 = v[ip.y0 + it];
+                        vol = y1 + (y2 - y1) * ((s - x1) / (x2 - x1));
+                    }
+                    my_growths[k] = ::exp((v[my_steps[in.aux].mu] - 0.5 * vol * vol) * in.c + vol * ::sqrt(in.c) * v[in.b]);
+                    v[k] = s * my_growths[k];
+                    break;
+                }
+            }
+        }
+    }
+
+    double value(const slot_t slot) const {return my_values[slot];}
+
+    // Reverse sweep of the last replay from output (adjoint 1). Parameter adjoints are summed.
+    // Adjoints of path instructions are reset as they are consumed.
+    void reverse(const slot_t output)
+    {
+        const double* v = my_values.data();
+        double*       d = my_adjoints.data();
+        d[output] += 1.;
+
+        const slot_t* first = my_path_code.data();
+        const slot_t* last  = std::upper_bound(first, first + my_path_code.size(), output);
+        for (const slot_t* it = last; it-- != first;)
+        {
+            const slot_t k   = *it;
+            const double adj = d[k];
+            if (!adj) continue;
+            d[k] = 0.;
+
+            const Replay_instr& in = my_code[k];
+            switch (in.op)
+            {
+                case replay_ops::constant:  break;
+                case replay_ops::input:     break;
+                case replay_ops::param:     break;
+                case replay_ops::add:       d[in.a] += adj; d[in.b] += adj; break;
+                case replay_ops::sub:       d[in.a] += adj; d[in.b] -= adj; break;
+                case replay_ops::mul:       d[in.a] += adj * v[in.b]; d[in.b] += adj * v[in.a]; break;
+                case replay_ops::div:       d[in.a] += adj / v[in.b]; d[in.b] -= adj * v[k] / v[in.b]; break;
+                case replay_ops::add_c:     d[in.a] += adj; break;
+                case replay_ops::sub_c:     d[in.a] += adj; break;
+                case replay_ops::c_sub:     d[in.a] -= adj; break;
+                case replay_ops::mul_c:     d[in.a] += adj * in.c; break;
+                case replay_ops::div_c:     d[in.a] += adj / in.c; break;
+                case replay_ops::c_div:     d[in.a] -= adj * v[k] / v[in.a]; break;
+                case replay_ops::pow_c:     d[in.a] += adj * in.c * v[k] / v[in.a]; break;
+                case replay_ops::max:       if (v[in.a] > v[in.b]) d[in.a] += adj; else d[in.b] += adj; break;
+                case replay_ops::min:       if (v[in.a] < v[in.b]) d[in.a] += adj; else d[in.b] += adj; break;
+                case replay_ops::neg:       d[in.a] -= adj; break;
+                case replay_ops::exp:       d[in.a] += adj * v[k]; break;
+                case replay_ops::log:       d[in.a] += adj / v[in.a]; break;
+                case replay_ops::sqrt:      d[in.a] += adj * 0.5 / v[k]; break;
+                case replay_ops::normalCdf: d[in.a] += adj * gaussian::normalDens(v[in.a]); break;
+                case replay_ops::select:    if (v[in.a] > 0) d[in.b] += adj; else d[in.aux] += adj; break;
+                case replay_ops::interp:
+                {
+                    const Interp& ip = my_interps[in.aux];
+                    const size_t  it = my_buckets[k];
+                    if (it == ip.n)     {d[ip.y0 + ip.n - 1] += adj; break;}
+                    if (it == 0)        {d[ip.y0] += adj; break;}
+                    const double x1 = ip.xs[it - 1], x2 = ip.xs[it];
+                    const double y1 = v[ip.y0 + it - 1], y2 = v[ip.y0 + it];
+                    const double t  = (v[in.a] - x1) / (x2 - x1);
+                    d[in.a]           += adj * (y2 - y1) / (x2 - x1);
+                    d[ip.y0 + it - 1] += adj * (1 - t);
+                    d[ip.y0 + it]     += adj * t;
+                    break;
+                }
+                case replay_ops::lv_step:
+                {
+                    // partials of local_vol_step() in Fused.hpp, the gaussian is an input
+                    const Step&   st = my_steps[in.aux];
+                    const Interp& ip = my_interps[st.row];
+                    const size_t  it = my_buckets[k];
+                    const double  s  = v[in.a], dt = in.c;
+                    const bool inside = it != 0 && it != ip.n;
+                    const size_t  n  = it == ip.n ? ip.n - 1 : inside ? it - 1 : 0;
+                    double t = 0., vol = v[ip.y0 + n], dvol_ds = 0.;
+                    if (inside)
+                    {
+                        const double dx = ip.xs[n + 1] - ip.xs[n];
+                        const double dy = v[ip.y0 + n + 1] - v[ip.y0 + n];
+                        t       = (s - ip.xs[n]) / dx;
+                        vol     = vol + dy * t;
+                        dvol_ds = dy / dx;
+                    }
+                    const double dvol = adj * v[k] * (::sqrt(dt) * v[in.b] - vol * dt);
+                    d[in.a]                         += adj * my_growths[k] + dvol * dvol_ds;
+                    d[st.mu]                        += adj * v[k] * dt;
+                    d[ip.y0 + n]                    += dvol * (1. - t);
+                    d[ip.y0 + (inside ? n + 1 : n)] += dvol * t;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Adds the parameter adjoints summed over paths to their nodes on tape, and resets them
+    void flush_adjoints()
+    {
+        if (my_prepared != my_code.size()) return;
+        for (size_t i = 0; i < my_param_list.size(); ++i)
+        {
+            double& adj = my_adjoints[my_param_list[i]];
+            Tdouble::tape->get_adjoint(my_param_nodes[my_code[my_param_list[i]].aux]) += adj;
+            adj = 0.;
+        }
+    }
+};
+
+// Recording handle of Replay_tape. Holds a slot, or a constant which is folded into the instructions.
+class Rdouble
+{
+private:
+    static constexpr Replay_tape::slot_t constant_slot = UINT32_MAX;
+
+    Replay_tape::slot_t my_slot  = constant_slot;
+    double              my_value = 0.;
+
+    static Rdouble from_slot(const Replay_tape::slot_t slot)
+    {
+        Rdouble res;
+        res.my_slot = slot;
+        return res;
+    }
+
+public:
+    // program being recorded
+    static Replay_tape* tape;
+
+    Rdouble() {}
+    Rdouble(const double value_) : my_value(value_) {}
+    Rdouble(const Tdouble& x) : my_slot(tape->param(x)) {}
+
+    // Path input k
+    static Rdouble input(const size_t k) {return from_slot(tape->input(k));}
+
+    bool is_constant() const {return my_slot == constant_slot;}
+    Replay_tape::slot_t get_slot() const {return is_constant() ? tape->emit(replay_ops::constant, 0, 0, 0, my_value) : my_slot;}
+
+// ---------------------------------------------------------------
+// - BINARY OPERATORS
+// ---------------------------------------------------------------
+    inline friend Rdouble operator+(const Rdouble& l_arg, const Rdouble& r_arg)
+    {
+        if (l_arg.is_constant() && r_arg.is_constant()) return l_arg.my_value + r_arg.my_value;
+        if (r_arg.is_constant()) return from_slot(tape->emit(replay_ops::add_c, l_arg.my_slot, 0, 0, r_arg.my_value));
+        if (l_arg.is_constant()) return from_slot(tape->emit(replay_ops::add_c, r_arg.my_slot, 0, 0, l_arg.my_value));
+        return from_slot(tape->emit(replay_ops::add, l_arg.my_slot, r_arg.my_slot));
+    }
+
+    inline friend Rdouble operator-(const Rdouble& l_arg, const Rdouble& r_arg)
+    {
+        if (l_arg.is_constant() && r_arg.is_constant()) return l_arg.my_value - r_arg.my_value;
+        if (r_arg.is_constant()) return from_slot(tape->emit(replay_ops::sub_c, l_arg.my_slot, 0, 0, r_arg.my_value));
+        if (l_arg.is_constant()) return from_slot(tape->emit(replay_ops::c_sub, r_arg.my_slot, 0, 0, l_arg.my_value));
+        return from_slot(tape->emit(replay_ops::sub, l_arg.my_slot, r_arg.my_slot));
+    }
+
+    inline friend Rdouble operator*(const Rdouble& l_arg, const Rdouble& r_arg)
+    {
+        if (l_arg.is_constant() && r_arg.is_constant()) return l_arg.my_value * r_arg.my_value;
+        if (r_arg.is_constant()) return from_slot(tape->emit(replay_ops::mul_c, l_arg.my_slot, 0, 0, r_arg.my_value));
+        if (l_arg.is_constant()) return from_slot(tape->emit(replay_ops::mul_c, r_arg.my_slot, 0, 0, l_arg.my_value));
+        return from_slot(tape->emit(replay_ops::mul, l_arg.my_slot, r_arg.my_slot));
+    }
+
+    inline friend Rdouble operator/(const Rdouble& l_arg, const Rdouble& r_arg)
+    {
+        if (l_arg.is_constant() && r_arg.is_constant()) return l_arg.my_value / r_arg.my_value;
+        if (r_arg.is_constant()) return from_slot(tape->emit(replay_ops::div_c, l_arg.my_slot, 0, 0, r_arg.my_value));
+        if (l_arg.is_constant()) return from_slot(tape->emit(replay_ops::c_div, r_arg.my_slot, 0, 0, l_arg.my_value));
+        return from_slot(tape->emit(replay_ops::div, l_arg.my_slot, r_arg.my_slot));
+    }
+
+    // Kinks, the branch is taken at replay
+    inline friend Rdouble max(const Rdouble& l_arg, const Rdouble& r_arg)
+    {
+        if (l_arg.is_constant() && r_arg.is_constant()) return std::max(l_arg.my_value, r_arg.my_value);
+        return from_slot(tape->emit(replay_ops::max, l_arg.get_slot(), r_arg.get_slot()));
+    }
+
+    inline friend Rdouble min(const Rdouble& l_arg, const Rdouble& r_arg)
+    {
+        if (l_arg.is_constant() && r_arg.is_constant()) return std::min(l_arg.my_value, r_arg.my_value);
+        return from_slot(tape->emit(replay_ops::min, l_arg.get_slot(), r_arg.get_slot()));
+    }
+
+    // cond > 0 ? if_pos : if_neg
+    inline friend Rdouble select(const Rdouble& cond, const Rdouble& if_pos, const Rdouble& if_neg)
+    {
+        if (cond.is_constant()) return cond.my_value > 0 ? if_pos : if_neg;
+        return from_slot(tape->emit(replay_ops::select, cond.my_slot, if_pos.get_slot(), if_neg.get_slot()));
+    }
+
+    inline friend Rdouble pow(const Rdouble& l_arg, const double r_arg)
+    {
+        if (l_arg.is_constant()) return ::pow(l_arg.my_value, r_arg);
+        return from_slot(tape->emit(replay_ops::pow_c, l_arg.my_slot, 0, 0, r_arg));
+    }
+
+// ---------------------------------------------------------------
+// - UNARY OPERATORS
+// ---------------------------------------------------------------
+#define RDOUBLE_UNARY(FUNC, OP, EVAL)                                                           \
+    inline friend Rdouble FUNC(const Rdouble& arg)                                              \
+    {                                                                                           \
+        if (arg.is_constant()) return EVAL(arg.my_value);                                       \
+        return from_slot(tape->emit(replay_ops::OP, arg.my_slot));                              \
+    }
+
+    RDOUBLE_UNARY(operator-, neg, -)
+    RDOUBLE_UNARY(exp, exp, ::exp)
+    RDOUBLE_UNARY(log, log, ::log)
+    RDOUBLE_UNARY(sqrt, sqrt, ::sqrt)
+    RDOUBLE_UNARY(normalCdf, normalCdf, gaussian::normalCdf)
+
+#undef RDOUBLE_UNARY
+
+    Rdouble operator+() const {return *this;}
+
+    // interp() of interp.hpp on a row of Tdoubles, the bucket is chosen at replay
+    template <class ITX, class ITY>
+    inline friend Rdouble interp(ITX xBegin, ITX xEnd, ITY yBegin, ITY, const Rdouble& x0)
+    {
+        if (x0.is_constant()) std::__throw_runtime_error("Rdouble: interp() of a constant is not supported");
+        return from_slot(tape->interp(&*xBegin, &*yBegin, size_t(xEnd - xBegin), x0.my_slot));
+    }
+
+    // local_vol_step() of Fused.hpp as one instruction, z is a path input
+    inline friend Rdouble local_vol_step(const std::vector<double>& spots, const Tdouble* row, const Rdouble& spot,
+        const Rdouble& mu, const double dt, const Rdouble& z)
+    {
+        return from_slot(tape->local_vol_step(spots.data(), row, spots.size(), spot.get_slot(), mu.get_slot(), dt, z.get_slot()));
+    }
+
+    Rdouble& operator+=(const Rdouble& arg) {*this = *this + arg; return *this;}
+    Rdouble& operator-=(const Rdouble& arg) {*this = *this - arg; return *this;}
+    Rdouble& operator*=(const Rdouble& arg) {*this = *this * arg; return *this;}
+    Rdouble& operator/=(const Rdouble& arg) {*this = *this / arg; return *this;}
+};
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef SOBOL_HPP
+#define SOBOL_HPP
+
+// STL includes
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// user includes
+#include "RNG_base.hpp"
+#include "Gaussian.hpp"
+#include "Mrg32k.hpp"
+
+namespace RNG
+{
+    // Sobol low discrepancy sequence in Gray code order, 32 bit, without antithetics.
+    // Dimension d > 0 uses the d'th primitive polynomial over GF(2), by degree and then coefficients as in
+    // Joe and Kuo (2008). The initial direction numbers of the first 21 dimensions are theirs
+    // (new-joe-kuo-6.21201), further dimensions get random odd ones from a fixed MRG32k3a stream, so
+    // there is no limit on the dimension beyond the cost of init(): about 3700 dimensions up to degree 15.
+    // The point 0 is skipped, uniforms are (x + 0.5) / 2^32 so the inverse normal stays finite.
+    // With a seed every dimension is XORed with a random 32 bit shift (digital shift): the points stay a
+    // (t, s)-sequence and the estimator is unbiased, so prices over a few seeds give an error bar.
+    // Sobol(seed, first) starts at point first (reset_members() too), e.g. the first path of a chunk in
+    // parallel_MC(), and skip_ahead(n) jumps to point n directly.
+    class Sobol : public RNG_base
+    {
+    private:
+        size_t                      my_dim = 0;
+        const unsigned              my_seed;
+        const std::uint64_t         my_first;
+        // direction numbers, 32 per dimension, and the digital shift of each dimension
+        std::vector<std::uint32_t>  my_directions;
+        std::vector<std::uint32_t>  my_shifts;
+        // current point (shift included) and its index
+        std::vector<std::uint32_t>  my_point;
+        std::uint64_t               my_index = 0;
+
+        static constexpr double my_norm = 1. / 4294967296.;
+
+        // degree and coefficients a, initial m_1 .. m_degree of dimensions 1 to 20 (Joe and Kuo)
+        struct Initial {unsigned degree, a; std::uint32_t m[7];};
+        static constexpr Initial my_initial[20] = {
+            {1, 0,  {1}},
+            {2, 1,  {1, 3}},
+            {3, 1,  {1, 3, 1}},
+            {3, 2,  {1, 1, 1}},
+            {4, 1,  {1, 1, 3, 3}},
+            {4, 4,  {1, 3, 5, 13}},
+            {5, 2,  {1, 1, 5, 5, 17}},
+            {5, 4,  {1, 1, 5, 5, 5}},
+            {5, 7,  {1, 1, 7, 11, 19}},
+            {5, 11, {1, 1, 5, 1, 1}},
+            {5, 13, {1, 1, 1, 3, 11}},
+            {5, 14, {1, 3, 5, 5, 31}},
+            {6, 1,  {1, 3, 3, 9, 7, 49}},
+            {6, 13, {1, 1, 1, 15, 21, 21}},
+            {6, 16, {1, 3, 1, 13, 27, 49}},
+            {6, 19, {1, 1, 1, 15, 7, 5}},
+            {6, 22, {1, 3, 1, 15, 13, 25}},
+            {6, 25, {1, 1, 5, 5, 19, 61}},
+            {7, 1,  {1, 3, 7, 11, 23, 15, 103}},
+            {7, 4,  {1, 3, 7, 13, 13, 15, 69}}};
+
+        // x^(2^degree - 1) = 1 mod p and x^((2^degree - 1) / q) != 1 for the prime factors q
+        static bool primitive(const std::uint64_t p, const unsigned degree)
+        {
+            auto mult = [&](std::uint64_t a, std::uint64_t b)
+            {
+                std::uint64_t res = 0;
+                for (; b; b >>= 1)
+                {
+                    if (b & 1) res ^= a;
+                    a <<= 1;
+                    if (a >> degree & 1) a ^= p;
+                }
+                return res;
+            };
+            auto power = [&](std::uint64_t e)
+            {
+                std::uint64_t res = 1, x = degree == 1 ? 2 ^ p : 2;
+                for (; e; e >>= 1, x = mult(x, x)) if (e & 1) res = mult(res, x);
+                return res;
+            };
+
+            const std::uint64_t order = (std::uint64_t(1) << degree) - 1;
+            if (power(order) != 1) return false;
+            std::uint64_t rest = order;
+            for (std::uint64_t q = 2; q * q <= rest; ++q)
+            {
+                if (rest % q) continue;
+                if (power(order / q) == 1) return false;
+                while (rest % q == 0) rest /= q;
+            }
+            return rest == 1 || power(order / rest) != 1;
+        }
+
+        void directions()
+        {
+            my_directions.assign(32 * my_dim, 0);
+
+            // dimension 0: van der Corput
+            for (size_t k = 0; k < 32; ++k) my_directions[k] = std::uint32_t(1) << (31 - k);
+
+            Mrg32k_RNG initial_rng = Mrg32k_RNG::stream(0, 0);
+            initial_rng.init(1);
+            std::vector<double> u(1);
+
+            unsigned degree = 1;
+            std::uint64_t a = 0;
+            for (size_t d = 1; d < my_dim; ++d)
+            {
+                // next primitive polynomial x^degree + a_1 x^(degree - 1) + ... + a_(degree - 1) x + 1
+                while (!primitive(std::uint64_t(1) << degree | a << 1 | 1, degree))
+                {
+                    if (++a == std::uint64_t(1) << (degree - 1)) {a = 0; ++degree;}
+                }
+                if (degree > 31) std::__throw_runtime_error("Sobol: dimension too high");
+
+                std::uint32_t m[32];
+                for (size_t k = 0; k < degree; ++k)
+                {
+                    if (d <= 20) m[k] = my_initial[d - 1].m[k];
+                    else
+                    {
+                        // odd, below 2^(k + 1)
+                        initial_rng.nextU(u);
+                        m[k] = 2 * std::uint32_t(u[0] * double(std::uint32_t(1) << k)) + 1;
+                    }
+                }
+                for (size_t k = degree; k < 32; ++k)
+                {
+                    m[k] = m[k - degree] ^ m[k - degree] << degree;
+                    for (size_t i = 1; i < degree; ++i) if (a >> (degree - 1 - i) & 1) m[k] ^= m[k - i] << i;
+                }
+
+                std::uint32_t* v = &my_directions[32 * d];
+                for (size_t k = 0; k < 32; ++k) v[k] = m[k] << (31 - k);
+
+                if (++a == std::uint64_t(1) << (degree - 1)) {a = 0; ++degree;}
+            }
+        }
+
+        // next point in Gray code order: flip the direction of the lowest zero bit of the index
+        void next_point()
+        {
+            size_t bit = 0;
+            for (std::uint64_t n = my_index; n & 1; n >>= 1) ++bit;
+            if (bit >= 32) std::__throw_runtime_error("Sobol: more than 2^32 points");
+            ++my_index;
+            for (size_t d = 0; d < my_dim; ++d) my_point[d] ^= my_directions[32 * d + bit];
+        }
+
+    public:
+        // seed 0 for the plain sequence, else the seed of the digital shift
+        Sobol(const unsigned seed = 0, const std::uint64_t first = 1) : my_seed(seed), my_first(first) {}
+
+        void init(const size_t simDim) override
+        {
+            my_dim = simDim;
+            directions();
+
+            my_shifts.assign(my_dim, 0);
+            if (my_seed)
+            {
+                Mrg32k_RNG shift_rng = Mrg32k_RNG::stream(1, my_seed);
+                shift_rng.init(my_dim);
+                std::vector<double> u(my_dim);
+                shift_rng.nextU(u);
+                for (size_t d = 0; d < my_dim; ++d) my_shifts[d] = std::uint32_t(u[d] * 4294967296.);
+            }
+            reset_members();
+        }
+
+        void reset_members() override
+        {
+            skip_ahead(my_first);
+        }
+
+        // Next draw is point n (with the Gray code index of n)
+        void skip_ahead(const std::uint64_t n)
+        {
+            my_point = my_shifts;
+            my_index = n;
+            const std::uint64_t gray = n ^ (n >> 1);
+            for (size_t bit = 0; bit < 64 && gray >> bit; ++bit)
+            {
+                if (!(gray >> bit & 1)) continue;
+                if (bit >= 32) std::__throw_runtime_error("Sobol: more than 2^32 points");
+                for (size_t d = 0; d < my_dim; ++d) my_point[d] ^= my_directions[32 * d + bit];
+            }
+        }
+
+        void nextU(std::vector<double>& uVec) override
+        {
+            nextU_block(uVec.data(), 1);
+        }
+
+        void nextG(std::vector<double>& gVec) override
+        {
+            nextG_block(gVec.data(), 1);
+        }
+
+        void nextU_block(double* uniforms, const size_t n) override
+        {
+            for (size_t i = 0; i < n; ++i, uniforms += my_dim)
+            {
+                for (size_t d = 0; d < my_dim; ++d) uniforms[d] = (my_point[d] + 0.5) * my_norm;
+                next_point();
+            }
+        }
+
+        void nextG_block(double* gaussians, const size_t n) override
+        {
+            nextU_block(gaussians, n);
+            gaussian::invNormalCdf(gaussians, gaussians, n * my_dim);
+        }
+    };
+}
+
+#endif
@@ -7,6 +7,7 @@
 #include <math.h>
 
 #include "Products.hpp"
+#include "Checkpoint.hpp"
 
 template<typename T = double>
 struct Surface_results
@@ -15,9 +16,31 @@ struct Surface_results
     Matrix<T> iVol, lVol;
 };
 
-Surface_results<double> Generate_surface(Model& model, std::vector<double> spots, std::vector<double> mats)
+// Implied and local vol of the model at a grid point
+template<typename T>
+std::array<T, 2> Surface_point(Model<T>& model, double spot, double mat)
 {
-    Surface_results<double> res;
+    return {model.iVol(spot, mat), model.Dupires_LV(spot, mat)};
+}
+
+// With Tdouble parameters the cell's subgraph (the Fourier integrals of 6 call prices) is preaccumulated
+// to two nodes on the model parameters (see preaccumulate() in Checkpoint.hpp), so the tape holds two
+// nodes per cell instead of ~10^5.
+inline std::array<Tdouble, 2> Surface_point(Model<Tdouble>& model, double spot, double mat)
+{
+    return preaccumulate<2>(model.parameters(), [&] ()
+    {
+        return std::array<Tdouble, 2>{model.iVol(spot, mat), model.Dupires_LV(spot, mat)};
+    });
+}
+
+// With T = Tdouble the surface is recorded on tape as a function of model.parameters(), which must be
+// on tape. Pricing with it (e.g. MC_European_CallOption_AAD) and propagating to start then gives the
+// model parameter risk in one sweep, instead of converting a double surface with Convert_to_Tdouble.
+template<typename T>
+Surface_results<T> Generate_surface(Model<T>& model, std::vector<double> spots, std::vector<double> mats)
+{
+    Surface_results<T> res;
     res.spots = spots;
     res.mats = mats;
 
@@ -25,10 +48,10 @@ Surface_results<double> Generate_surface(Model& model, std::vector<double> spots
     size_t m = mats.size();
 
     // our implied volatility surface. mats as rows and spots as cols seems confusing but makes sense in MC later.
-    Matrix<double> iVol(m, n);
+    Matrix<T> iVol(m, n);
 
     // our local volatility surface. Still mats as rows and spots as cols also for MC.
-    Matrix<double> lVol(m, n);
+    Matrix<T> lVol(m, n);
 
 
     // find ATM!
@@ -48,8 +71,9 @@ Surface_results<double> Generate_surface(Model& model, std::vector<double> spots
     // ATM iVol and lVol (assumption: ATM Vols are stable.)
     for(size_t i=0; i<m; ++i)
     {
-        iVol[i][idx] = model.iVol(spots[idx], mats[i]);
-        lVol[i][idx] = model.Dupires_LV(spots[idx], mats[i]);
+        const std::array<T, 2> point = Surface_point(model, spots[idx], mats[i]);
+        iVol[i][idx] = point[0];
+        lVol[i][idx] = point[1];
     }
 
     double tol = 0.02;
@@ -59,9 +83,10 @@ Surface_results<double> Generate_surface(Model& model, std::vector<double> spots
         bool go_flat = false;
         for(size_t j=idx; j --> 0;)
         {
-            double ires = model.iVol(spots[j], mats[i]);
-            double lres = model.Dupires_LV(spots[j], mats[i]);
-            if(go_flat || abs(lres - lVol[i][j+1]) > tol || abs(ires - iVol[i][j+1]) > tol || isnan(lres) || isinf(lres))
+            const std::array<T, 2> point = Surface_point(model, spots[j], mats[i]);
+            double ires = double(point[0]);
+            double lres = double(point[1]);
+            if(go_flat || abs(lres - double(lVol[i][j+1])) > tol || abs(ires - double(iVol[i][j+1])) > tol || isnan(lres) || isinf(lres))
             {
                 go_flat = true;
                 iVol[i][j] = iVol[i][j+1];
@@ -69,8 +94,8 @@ Surface_results<double> Generate_surface(Model& model, std::vector<double> spots
             }
             else
             {
-                iVol[i][j] = ires;
-                lVol[i][j] = lres;
+                iVol[i][j] = point[0];
+                lVol[i][j] = point[1];
             }
         }
     }
@@ -80,9 +105,10 @@ Surface_results<double> Generate_surface(Model& model, std::vector<double> spots
         bool go_flat = false;
         for(size_t j=idx; j<n; ++j) // j is not decremented at loop entry so j=idx at start.
         {
-            double ires = model.iVol(spots[j], mats[i]);
-            double lres = model.Dupires_LV(spots[j], mats[i]);
-            if(go_flat || abs(lres - lVol[i][j-1]) > tol || abs(ires - iVol[i][j-1]) > tol || isnan(lres) || isinf(lres))
+            const std::array<T, 2> point = Surface_point(model, spots[j], mats[i]);
+            double ires = double(point[0]);
+            double lres = double(point[1]);
+            if(go_flat || abs(lres - double(lVol[i][j-1])) > tol || abs(ires - double(iVol[i][j-1])) > tol || isnan(lres) || isinf(lres))
             {
                 go_flat = true;
                 iVol[i][j] = iVol[i][j-1];
@@ -90,8 +116,8 @@ Surface_results<double> Generate_surface(Model& model, std::vector<double> spots
             }
             else
             {
-                iVol[i][j] = ires;
-                lVol[i][j] = lres;
+                iVol[i][j] = point[0];
+                lVol[i][j] = point[1];
             }
             
         }
@@ -119,7 +145,8 @@ std::vector<double> make_simulation_timeline(std::vector<double> A, std::vector<
     return res;
 }
 
-Surface_results<double> Generate_surface(Model& model, std::vector<double> spots, std::vector<double> mats, products::Product<double>& product)
+template<typename T>
+Surface_results<T> Generate_surface(Model<T>& model, std::vector<double> spots, std::vector<double> mats, products::Product<double>& product)
 {
     auto mats_ = make_simulation_timeline(mats, product.timeline());
 
@@ -138,6 +165,9 @@ Surface_results<Tdouble> Convert_to_Tdouble(const Surface_results<double> SR)
 
     Matrix<Tdouble> iVol = SR.iVol;
     Matrix<Tdouble> lVol = SR.lVol;
+    // surface entries are inputs
+    for (auto& vol : iVol) vol.put_on_tape();
+    for (auto& vol : lVol) vol.put_on_tape();
     res.iVol = iVol;
     res.lVol = lVol;
 
@@ -169,6 +199,32 @@ Surface_results<double> Get_adjoints_SR(Surface_results<Tdouble>& SR)
     return res;
 }
 
+// Adjoints of lane k after a vector mode propagation (see Tdouble::propagate_to_start<K>)
+Surface_results<double> Get_adjoints_SR(Surface_results<Tdouble>& SR, const size_t lane)
+{
+    Surface_results<double> res;
+    res.spots = SR.spots;
+    res.mats = SR.mats;
+
+    size_t rows = SR.lVol.get_rows();
+    size_t cols = SR.lVol.get_cols();
+    Matrix<double> iVol(rows, cols);
+    Matrix<double> lVol(rows, cols);
+
+    for(size_t i=0; i<rows; ++i)
+    {
+        for(size_t j=0; j<cols; ++j)
+        {
+            iVol[i][j] = SR.iVol[i][j].get_adjoint(lane);
+            lVol[i][j] = SR.lVol[i][j].get_adjoint(lane);
+        }
+    }
+    res.iVol = iVol;
+    res.lVol = lVol;
+
+    return res;
+}
+
 Surface_results<double> Get_value_SR(Surface_results<Tdouble>& SR)
 {
     Surface_results<double> res;
@@ -1,6 +1,11 @@
 #include "Tape.hpp"
 #include "Tdouble.hpp"
+#include "Replay.hpp"
 
-// globaltape_t is instantiated and assigned to the Tdouble class
+// globaltape_t is instantiated and assigned to the Tdouble class, the tape of every thread until it sets its own
 Tape globaltape_t; 
-Tape* Tdouble::tape = &globaltape_t; 
+thread_local Tape* Tdouble::tape = &globaltape_t; 
+
+// globalreplay_t is the program recorded by Rdouble (see Replay.hpp)
+Replay_tape globalreplay_t;
+Replay_tape* Rdouble::tape = &globalreplay_t;
@@ -3,89 +3,462 @@
 
 #include<vector>
 #include<memory>
+#include<cstdint>
+#include<algorithm>
+#include<utility>
+#include<chrono>
+#include<string>
 
-#include "Node.hpp"
 #include "List_array.hpp"
+#include "Tape_stats.hpp"
 
-#define LA_node_size    40000
-#define LA_dou_size     80000
-#define LA_douptr_size  80000
+// Default block sizes (see Tape::set_block_sizes()), rounded up to powers of 2 so node ids and
+// argument positions map to blocks by shifts
+#define LA_node_size    32768
+#define LA_dou_size     65536
 
+// Tape holding the DAG recorded by Tdouble (see Tdouble.hpp) as parallel arrays (structure of arrays).
+// A node is identified by its index (node id). Its children are stored as arguments: the partial
+// derivative (weight) and the child's node id. Arguments of node k are the positions
+// [my_arg_begin[k], my_arg_begin[k + 1]) in my_weights and my_children.
+// Adjoints live in one dense array indexed by node id.
+// Mixed precision (set_float_weights()): weights are rounded to float when recorded, in my_float_weights,
+// and the reverse sweep accumulates them into the double adjoints.
 class Tape
 {
-private:    
-    containers::List_array<Node, LA_node_size>      my_nodes;
-    containers::List_array<double, LA_dou_size>     my_nodes_weights;
-    containers::List_array<double*, LA_douptr_size> my_child_adjoints;
+    // parallel reverse sweep (see Level_sweep.hpp)
+    friend class Level_schedule;
 
 public:
-    Tape() {}
+    using index_t = uint32_t;
+
+    // Node id of passive values, i.e. constants not depending on any input. These are not on tape.
+    static constexpr index_t passive_index = UINT32_MAX;
+
+private:
+    // scratch file arena of set_memory_budget(), declared first so that it outlives the blocks
+    std::unique_ptr<containers::Spill_arena>        my_spill;
+    // first argument position of each node
+    containers::List_array<size_t>                  my_arg_begin;
+    // partial derivatives and child node ids, one entry per argument (same block size).
+    // Weights are in my_weights, or in my_float_weights with float weights.
+    containers::List_array<double>                  my_weights;
+    containers::List_array<float>                   my_float_weights;
+    containers::List_array<index_t>                 my_children;
+    // memory of the blocks, told when the tape is cleared
+    containers::Block_allocator*                    my_allocator = &containers::Heap_allocator::instance();
+    // adjoints indexed by node id
+    std::vector<double>                             my_adjoints;
+    // weights recorded in my_float_weights instead of my_weights
+    bool                                            my_float = false;
+
+    // Number of nodes and arguments recorded
+    size_t  my_n_nodes    = 0;
+    size_t  my_n_args     = 0;
+
+    // Node and argument counts at the mark
+    size_t  my_mark_nodes = 0;
+    size_t  my_mark_args  = 0;
+    bool    my_marked     = false;
+
+    // Nested marks above the mark, (nodes, arguments) at each push_mark()
+    std::vector<std::pair<size_t, size_t>>          my_mark_stack;
+
+    // Peak node and argument counts since last clear()
+    size_t  my_peak_nodes = 0;
+    size_t  my_peak_args  = 0;
+
+    // Adjoint handed out for passive values, always reset to 0
+    double  my_passive_adjoint = 0;
+
+    // Vector mode: my_lanes adjoints per node, indexed by node id * my_lanes + lane
+    std::vector<double>                             my_lane_adjoints;
+    size_t                                          my_lanes = 0;
+
+    // Instrumentation (see stats()): operation histogram, reverse sweeps and their time
+    std::array<size_t, tape_ops::n_ops>             my_ops = {};
+    size_t                                          my_sweeps = 0;
+    double                                          my_propagate_seconds = 0;
+    std::chrono::steady_clock::time_point           my_start = std::chrono::steady_clock::now();
+
+public:
+    explicit Tape(const size_t node_block = LA_node_size, const size_t arg_block = LA_dou_size)
+        : my_arg_begin(node_block), my_weights(arg_block), my_float_weights(arg_block), my_children(arg_block) {}
     ~Tape() {}
 
-    Node* record_node(size_t some_n)
+    // Memory of the blocks, e.g. an mmap arena for big tapes (see Arena.hpp). Clears the tape and
+    // deallocates its blocks. The allocator must outlive the tape or be replaced before it is destroyed.
+    void set_allocator(containers::Block_allocator& allocator)
+    {
+        clear();
+        my_allocator = &allocator;
+        my_arg_begin.set_allocator(allocator);
+        my_weights.set_allocator(allocator);
+        my_float_weights.set_allocator(allocator);
+        my_children.set_allocator(allocator);
+        if (my_spill.get() != &allocator) my_spill.reset();
+    }
+
+    // Out of core recording: the blocks go to a scratch file in 'directory' and about budget_bytes of
+    // them stay in memory (see Spill_arena in Arena.hpp). The budget covers the blocks only: the adjoints
+    // (a double per node, up to twice that as the vector grows, and K per node with lanes) stay in memory
+    // on top of it. reserve_bytes bounds the recording. A budget of 0 goes back to the heap. Clears the tape.
+    void set_memory_budget(
+        const size_t budget_bytes,
+        const std::string& directory = "/var/tmp",
+        const size_t reserve_bytes = size_t(1) << 38)
+    {
+        if (!budget_bytes) {set_allocator(containers::Heap_allocator::instance()); return;}
+        auto spill = std::make_unique<containers::Spill_arena>(reserve_bytes, budget_bytes, directory);
+        set_allocator(*spill);
+        my_spill = std::move(spill);
+    }
+
+    // Scratch file arena of set_memory_budget(), nullptr if none
+    const containers::Spill_arena* spill() const {return my_spill.get();}
+
+    // Block sizes of the nodes and the arguments. Clears the tape and deallocates its blocks.
+    void set_block_sizes(const size_t node_block, const size_t arg_block)
+    {
+        clear();
+        my_arg_begin.set_block_size(node_block);
+        my_weights.set_block_size(arg_block);
+        my_float_weights.set_block_size(arg_block);
+        my_children.set_block_size(arg_block);
+    }
+
+    // Weight storage: float halves the weight memory, at a relative error of about 6e-8 per weight. An argument
+    // takes 8 bytes instead of 12 (weight and child id), the 8 byte arg_begin per node stays: about 25% less tape
+    // memory at 3 arguments per node. The reverse sweep still reads the child id and its double adjoint per
+    // argument, it is no faster (bench_mixed_precision: about 4 ns per argument either way). Adjoints stay
+    // double. Clears the tape.
+    void set_float_weights(const bool float_weights)
+    {
+        clear();
+        my_float = float_weights;
+    }
+
+    bool   float_weights() const {return my_float;}
+    size_t weight_size()   const {return my_float ? sizeof(float) : sizeof(double);}
+
+    // Records a node. Its arguments must be added with push_arg() before the next node is recorded.
+    index_t record_node()
     {
-	// in-place construction of node
-        Node* res_node = my_nodes.emplace_back<Node>(some_n);
+        const size_t node = my_n_nodes++;
+        my_arg_begin.emplace_back(my_n_args);
+
+        // reset adjoint of the node, the slot is reused after set_to_mark()
+        if (node < my_adjoints.size()) my_adjoints[node] = 0;
+        else                           my_adjoints.push_back(0);
+
+        return index_t(node);
+    }
 
-        if (some_n)
+    // Adds an argument (partial derivative and child) to the most recently recorded node
+    void push_arg(const double weight, const index_t child)
+    {
+        if (my_float) my_float_weights.emplace_back(float(weight));
+        else          my_weights.emplace_back(weight);
+        my_children.emplace_back(child);
+        ++my_n_args;
+    }
+
+    double& get_adjoint(const index_t node) 
+    {
+        if (node == passive_index)
         {
-	    // request space in the containers
-            res_node->get_weights() = my_nodes_weights.emplace_back_n(some_n);
-            res_node->get_child_adjoint() = my_child_adjoints.emplace_back_n(some_n);
+            my_passive_adjoint = 0;
+            return my_passive_adjoint;
         }
+        return my_adjoints[node];
+    }
 
-        return res_node;
+    // Sizes
+    size_t nodes() const {return my_n_nodes;}
+    size_t args()  const {return my_n_args;}
+    size_t peak_nodes() const {return std::max(my_peak_nodes, my_n_nodes);}
+    size_t peak_args()  const {return std::max(my_peak_args, my_n_args);}
+    size_t mark_nodes() const {return my_mark_nodes;}
+    size_t mark_args()  const {return my_mark_args;}
+
+    // Bytes used by n_nodes nodes with n_args arguments, adjoints included
+    static size_t bytes(const size_t n_nodes, const size_t n_args, const size_t weight_size = sizeof(double))
+    {
+        return n_nodes * (sizeof(size_t) + sizeof(double)) + n_args * (weight_size + sizeof(index_t));
     }
 
-    containers::List_array<Node, LA_node_size>& get_nodes(){return my_nodes;}
+    // Reverse sweep from node 'from' down to node 'to', both included.
+    void propagate(const size_t from, const size_t to)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        sweep<1>(my_adjoints.data(), from, to);
+        time_sweep(start);
+    }
 
-    using iterator = containers::List_array<Node, LA_node_size>::iterator;
+    // Vector mode: reverse sweep of K adjoints per node (lanes) in one traversal.
+    // Lane adjoints are separate from the scalar adjoints, see get_adjoint(node, lane).
+    template<size_t K>
+    void propagate_lanes(const size_t from, const size_t to)
+    {
+        if (my_lanes != K) set_lanes(K);
+        fit_lanes();
+        const auto start = std::chrono::steady_clock::now();
+        sweep<K>(my_lane_adjoints.data(), from, to);
+        time_sweep(start);
+    }
 
-    iterator begin()
+    // Resets the lane adjoints to zero for K lanes
+    void set_lanes(const size_t K)
     {
-        return my_nodes.begin();
+        my_lanes = K;
+        my_lane_adjoints.assign(nodes() * K, 0.);
     }
 
-    iterator end()
+    size_t lanes() const {return my_lanes;}
+
+    // Adjoint of a node in a lane of the vector mode
+    double& get_adjoint(const index_t node, const size_t lane)
     {
-        return my_nodes.end();
+        if (node == passive_index || lane >= my_lanes)
+        {
+            my_passive_adjoint = 0;
+            return my_passive_adjoint;
+        }
+        fit_lanes();
+        return my_lane_adjoints[node * my_lanes + lane];
     }
 
-    iterator marked_it()
+    // Counts an operation of a recorded expression (TAPE_STATS)
+    void count_op(const tape_ops::Op op)
     {
-        return my_nodes.mark();
+        ++my_ops[op];
     }
 
+    // Counters, peaks since the last clear(), blocks, sweep timings and the operation histogram
+    Tape_stats stats() const
+    {
+        Tape_stats res;
+        res.nodes       = nodes();
+        res.weights     = args();
+        res.children    = args();
+        res.bytes       = bytes(nodes(), args(), weight_size());
+        res.peak_nodes  = peak_nodes();
+        res.peak_args   = peak_args();
+        res.peak_bytes  = bytes(peak_nodes(), peak_args(), weight_size());
+        res.weight_size = weight_size();
+
+        res.arg_begin_blocks = my_arg_begin.n_blocks();
+        res.weight_blocks    = my_float ? my_float_weights.n_blocks() : my_weights.n_blocks();
+        res.children_blocks  = my_children.n_blocks();
+        res.free_blocks      = my_arg_begin.n_free_blocks() + my_weights.n_free_blocks() + my_float_weights.n_free_blocks()
+                             + my_children.n_free_blocks();
+        res.node_block_size  = my_arg_begin.block_size();
+        res.arg_block_size   = my_weights.block_size();
+        res.allocated_bytes  = (res.arg_begin_blocks + my_arg_begin.n_free_blocks()) * res.node_block_size * sizeof(size_t)
+                             + (my_weights.n_blocks() + my_weights.n_free_blocks()) * res.arg_block_size * sizeof(double)
+                             + (my_float_weights.n_blocks() + my_float_weights.n_free_blocks()) * res.arg_block_size * sizeof(float)
+                             + (res.children_blocks + my_children.n_free_blocks()) * res.arg_block_size * sizeof(index_t)
+                             + (my_adjoints.capacity() + my_lane_adjoints.capacity()) * sizeof(double);
+
+        res.mark_nodes  = my_mark_nodes;
+        res.mark_depth  = my_mark_stack.size();
+        res.sweeps      = my_sweeps;
+
+        const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - my_start).count();
+        res.propagate_seconds = my_propagate_seconds;
+        res.other_seconds     = std::max(total - my_propagate_seconds, 0.);
+        res.ops               = my_ops;
+        return res;
+    }
+
+private:
+    void time_sweep(const std::chrono::steady_clock::time_point start)
+    {
+        my_propagate_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ++my_sweeps;
+    }
+
+    // Lane adjoints of nodes recorded since the last vector sweep are zero
+    void fit_lanes()
+    {
+        if (my_lane_adjoints.size() < nodes() * my_lanes) my_lane_adjoints.resize(nodes() * my_lanes, 0.);
+    }
+
+    // Reverse sweep with K adjoints per node (node major), on the weights of the storage mode
+    template<size_t K>
+    void sweep(double* adjoints, const size_t from, const size_t to)
+    {
+        if (my_float) sweep<K>(adjoints, from, to, my_float_weights);
+        else          sweep<K>(adjoints, from, to, my_weights);
+    }
+
+    // Linear scan backwards through the parallel arrays, a block of nodes at a time.
+    // The K lanes are updated together in the inner loop, which the compiler vectorizes.
+    template<size_t K, typename W>
+    void sweep(double* adjoints, const size_t from, const size_t to, const containers::List_array<W>& arg_weights)
+    {
+        size_t arg_end = from + 1 < nodes() ? my_arg_begin[from + 1] : args();
+
+        // nodes [to, from] a block at a time, last node first
+        my_arg_begin.for_each_block_reverse(to, from + 1, [&](const size_t* first, const size_t* last, const size_t offset)
+        {
+            read_ahead(offset, *first, arg_weights);
+            for (const size_t* it = last; it-- != first;)
+            {
+                const size_t  node      = offset + (it - first);
+                const size_t  arg_begin = *it;
+                const double* adjoint   = adjoints + node * K;
+
+                // If no childs or adjoint = 0, skip
+                bool zero = true;
+                for (size_t l = 0; l < K; ++l) zero &= !adjoint[l];
+
+                if (!zero && arg_begin != arg_end)
+                {
+                    // arguments of a node are contiguous unless they straddle two blocks
+                    if (arg_weights.block_of(arg_begin) == arg_weights.block_of(arg_end - 1))
+                    {
+                        const W*       weights  = &arg_weights[arg_begin];
+                        const index_t* children = &my_children[arg_begin];
+                        for (size_t i = 0; i < arg_end - arg_begin; ++i)
+                        {
+                            double* child = adjoints + children[i] * K;
+                            for (size_t l = 0; l < K; ++l) child[l] += weights[i] * adjoint[l];
+                        }
+                    }
+                    else
+                    {
+                        for (size_t arg = arg_begin; arg < arg_end; ++arg)
+                        {
+                            double* child = adjoints + my_children[arg] * K;
+                            for (size_t l = 0; l < K; ++l) child[l] += arg_weights[arg] * adjoint[l];
+                        }
+                    }
+                }
+                arg_end = arg_begin;
+            }
+        });
+    }
+
+    // Blocks of the nodes before 'node' and of the arguments before 'arg', reached next by the reverse sweep.
+    // Out of core they are read from the scratch file while the sweep works on the current blocks.
+    template<typename W>
+    void read_ahead(const size_t node, const size_t arg, const containers::List_array<W>& arg_weights)
+    {
+        const size_t node_block = my_arg_begin.block_of(node);
+        const size_t arg_block  = arg_weights.block_of(arg);
+        for (size_t i = 1; i <= 2; ++i)
+        {
+            if (node_block >= i) 
+                my_allocator->read_ahead(my_arg_begin.block(node_block - i), my_arg_begin.block_size() * sizeof(size_t));
+            if (arg_block >= i)
+            {
+                my_allocator->read_ahead(arg_weights.block(arg_block - i), arg_weights.block_size() * sizeof(W));
+                my_allocator->read_ahead(my_children.block(arg_block - i), my_children.block_size() * sizeof(index_t));
+            }
+        }
+    }
+
+public:
     void mark_tape()
     {
-        my_nodes.set_mark();
-        my_nodes_weights.set_mark();
-        my_child_adjoints.set_mark();
+        my_marked     = true;
+        my_mark_nodes = nodes();
+        my_mark_args  = args();
+        my_arg_begin.set_mark();
+        my_weights.set_mark();
+        my_float_weights.set_mark();
+        my_children.set_mark();
     }
 
     void set_to_mark()
     {
-        my_nodes.go_to_mark();
-        my_nodes_weights.go_to_mark();
-        my_child_adjoints.go_to_mark();
+        rewind(my_mark_nodes, my_mark_args);
+        my_arg_begin.go_to_mark();
+        my_weights.go_to_mark();
+        my_float_weights.go_to_mark();
+        my_children.go_to_mark();
+        my_mark_stack.clear();
     }
 
+    // Mark stack: nested marks on top of the mark, e.g. one per checkpointed segment of a path.
+    // set_to_top_mark() rewinds to the most recent pushed mark (the mark if none is pushed).
+    void push_mark()
+    {
+        my_mark_stack.emplace_back(nodes(), args());
+    }
+
+    void pop_mark()
+    {
+        if (my_mark_stack.empty()) {std::__throw_runtime_error("Mark stack is empty, cannot call 'Tape::pop_mark()'");}
+        my_mark_stack.pop_back();
+    }
+
+    void set_to_top_mark()
+    {
+        if (my_mark_stack.empty()) {set_to_mark(); return;}
+        rewind(my_mark_stack.back().first, my_mark_stack.back().second);
+        my_arg_begin.rewind(my_n_nodes);
+        if (my_float) my_float_weights.rewind(my_n_args);
+        else          my_weights.rewind(my_n_args);
+        my_children.rewind(my_n_args);
+    }
+
+    size_t top_mark_nodes() const {return my_mark_stack.empty() ? my_mark_nodes : my_mark_stack.back().first;}
+    size_t mark_depth()     const {return my_mark_stack.size();}
+
+private:
+    // Rewinds the counts, the arrays are moved by the caller
+    void rewind(const size_t n_nodes, const size_t n_args)
+    {
+        my_peak_nodes = peak_nodes();
+        my_peak_args  = peak_args();
+        my_n_nodes    = n_nodes;
+        my_n_args     = n_args;
+        // reset lane adjoints of the nodes to be reused
+        if (my_lane_adjoints.size() > my_n_nodes * my_lanes) my_lane_adjoints.resize(my_n_nodes * my_lanes);
+    }
+
+public:
+
     bool check_for_mark()
     {
-        return my_nodes.marked;
+        return my_marked;
     }
-    
-    iterator find(Node& f_node)
+
+    // Gives back the memory kept for reuse after clear() or a rewind to a mark: the free blocks of the
+    // arrays (to the allocator, an arena only takes back its last block) and the adjoint capacity past
+    // the recorded nodes. The next recording of the same size allocates again.
+    void shrink()
     {
-        return my_nodes.find(f_node);
+        my_arg_begin.trim();
+        my_weights.trim();
+        my_float_weights.trim();
+        my_children.trim();
+        if (my_adjoints.size() > nodes()) my_adjoints.resize(nodes());
+        my_adjoints.shrink_to_fit();
+        my_lane_adjoints.shrink_to_fit();
     }
 
     void clear()
     {
-        my_nodes.clear();
-        my_child_adjoints.clear();
-        my_nodes_weights.clear();
-
+        my_arg_begin.clear();
+        my_weights.clear();
+        my_float_weights.clear();
+        my_children.clear();
+        my_allocator->clear();
+        my_adjoints.clear();
+        my_lane_adjoints.clear();
+        my_lanes      = 0;
+        my_n_nodes    = my_n_args     = 0;
+        my_marked     = false;
+        my_mark_nodes = my_mark_args  = 0;
+        my_mark_stack.clear();
+        my_peak_nodes = my_peak_args  = 0;
+        my_ops.fill(0);
+        my_sweeps     = 0;
+        my_propagate_seconds = 0;
+        my_start      = std::chrono::steady_clock::now();
     }
 };
 
@@ -0,0 +1,109 @@
+#ifndef TAPE_STATS_HPP
+#define TAPE_STATS_HPP
+
+// STL includes
+#include <array>
+#include <ostream>
+#include <cstdint>
+
+// Operation codes of the tape, used for the per operation histogram (see Tape::stats()).
+// The histogram counts the operations in the expressions recorded on tape, and is only
+// filled when compiled with -DTAPE_STATS (counting walks every recorded expression).
+namespace tape_ops
+{
+    enum Op : uint8_t
+    {
+        leaf, add, sub, mul, div, pow, max, min,
+        neg, sqrt, exp, log, abs, sin, cos, normalCdf, normalDens, custom,
+        n_ops
+    };
+
+    inline const char* name(const size_t op)
+    {
+        static const char* names[n_ops] = {
+            "leaf", "add", "sub", "mul", "div", "pow", "max", "min",
+            "neg", "sqrt", "exp", "log", "abs", "sin", "cos", "normalCdf", "normalDens", "custom"};
+        return op < n_ops ? names[op] : "unknown";
+    }
+} // namespace tape_ops
+
+#ifdef TAPE_STATS
+#define TAPE_STATS_ENABLED true
+#else
+#define TAPE_STATS_ENABLED false
+#endif
+
+// Snapshot of the tape counters
+struct Tape_stats
+{
+    // Recorded now
+    size_t nodes = 0;
+    size_t weights = 0;
+    size_t children = 0;
+    size_t bytes = 0;
+    // bytes per weight, 4 with float weights (see Tape::set_float_weights())
+    size_t weight_size = sizeof(double);
+
+    // Peak since the last clear()
+    size_t peak_nodes = 0;
+    size_t peak_args = 0;
+    size_t peak_bytes = 0;
+
+    // Blocks in use in each List_array, blocks kept for reuse, block sizes,
+    // and bytes allocated (blocks and adjoints)
+    size_t arg_begin_blocks = 0;
+    size_t weight_blocks = 0;
+    size_t children_blocks = 0;
+    size_t free_blocks = 0;
+    size_t node_block_size = 0;
+    size_t arg_block_size = 0;
+    size_t allocated_bytes = 0;
+
+    // Nested marks, reverse sweeps
+    size_t mark_nodes = 0;
+    size_t mark_depth = 0;
+    size_t sweeps = 0;
+
+    // Cumulative seconds in propagate, and the rest of the wall time since the last clear(): recording, but also
+    // everything else the program did (random numbers, pricing on doubles, I/O, idle), recording is not timed
+    double propagate_seconds = 0;
+    double other_seconds = 0;
+
+    // Operations in recorded expressions, indexed by tape_ops::Op (TAPE_STATS only)
+    bool histogram = TAPE_STATS_ENABLED;
+    std::array<size_t, tape_ops::n_ops> ops = {};
+
+    void write_json(std::ostream& os) const
+    {
+        os << "{\n"
+           << "  \"nodes\": " << nodes << ",\n"
+           << "  \"weights\": " << weights << ",\n"
+           << "  \"children\": " << children << ",\n"
+           << "  \"bytes\": " << bytes << ",\n"
+           << "  \"weight_size\": " << weight_size << ",\n"
+           << "  \"peak_nodes\": " << peak_nodes << ",\n"
+           << "  \"peak_args\": " << peak_args << ",\n"
+           << "  \"peak_bytes\": " << peak_bytes << ",\n"
+           << "  \"blocks\": {\"arg_begin\": " << arg_begin_blocks
+           << ", \"weights\": " << weight_blocks
+           << ", \"children\": " << children_blocks
+           << ", \"free\": " << free_blocks << "},\n"
+           << "  \"block_sizes\": {\"nodes\": " << node_block_size
+           << ", \"args\": " << arg_block_size << "},\n"
+           << "  \"allocated_bytes\": " << allocated_bytes << ",\n"
+           << "  \"mark_nodes\": " << mark_nodes << ",\n"
+           << "  \"mark_depth\": " << mark_depth << ",\n"
+           << "  \"sweeps\": " << sweeps << ",\n"
+           << "  \"propagate_seconds\": " << propagate_seconds << ",\n"
+           << "  \"other_seconds\": " << other_seconds << ",\n"
+           << "  \"histogram\": " << (histogram ? "true" : "false") << ",\n"
+           << "  \"ops\": {";
+        for (size_t op = 0; op < tape_ops::n_ops; ++op)
+        {
+            os << (op ? ", " : "") << "\"" << tape_ops::name(op) << "\": " << ops[op];
+        }
+        os << "}\n}\n";
+    }
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef TCOMPLEX_HPP
+#define TCOMPLEX_HPP
+
+// STL includes
+#include <complex>
+
+// user includes
+#include "Tdouble.hpp"
+
+// Complex number of two Tdoubles (real and imaginary part), for the characteristic functions of
+// Bates_cf.hpp with T = Tdouble (see cf_complex in cf_funcs.hpp).
+// Values are computed with std::complex<double>, so they match the double code.
+// + and - record one node per part through the expressions of Texpr.hpp. *, /, exp, log, sqrt and pow
+// are holomorphic: with the complex derivative f'(z) = d, the Cauchy-Riemann equations give
+//      d re/d z.re =  Re(d)        d re/d z.im = -Im(d)
+//      d im/d z.re =  Im(d)        d im/d z.im =  Re(d)
+// so each part is recorded as one custom node (see Tdouble::custom_node()) with at most two
+// arguments per complex operand, whatever the number of operations in the std::complex formula.
+// Passive parts (e.g. the imaginary part of a real operand) are not recorded.
+class Tcomplex
+{
+private:
+    Tdouble my_re;
+    Tdouble my_im;
+
+public:
+    // CTORS
+    Tcomplex() : my_re(0.), my_im(0.) {}
+    Tcomplex(const double re_, const double im_ = 0.) : my_re(re_), my_im(im_) {}
+    Tcomplex(const std::complex<double>& z) : my_re(z.real()), my_im(z.imag()) {}
+    Tcomplex(const Tdouble& re_, const Tdouble& im_) : my_re(re_), my_im(im_) {}
+
+    // Real Tdouble or expression
+    template <class E>
+    Tcomplex(const Texpr<E>& re_) : my_re(re_), my_im(0.) {}
+
+    // Getters
+    const Tdouble& real() const {return my_re;}
+    const Tdouble& imag() const {return my_im;}
+    std::complex<double> value() const {return std::complex<double>(my_re.get_value(), my_im.get_value());}
+
+    bool is_active() const {return my_re.is_active() || my_im.is_active();}
+
+    // f(a) with value v and derivative da
+    static Tcomplex holomorphic(const std::complex<double>& v, const Tcomplex& a, const std::complex<double>& da)
+    {
+        const Tdouble* leaves[2] = {&a.my_re, &a.my_im};
+        const double   re_w[2]   = {da.real(), -da.imag()};
+        const double   im_w[2]   = {da.imag(),  da.real()};
+        return Tcomplex(
+            Tdouble::custom_node(v.real(), leaves, re_w, 2),
+            Tdouble::custom_node(v.imag(), leaves, im_w, 2));
+    }
+
+    // f(a, b) with value v and partial derivatives da and db
+    static Tcomplex holomorphic(
+        const std::complex<double>& v,
+        const Tcomplex& a, const std::complex<double>& da,
+        const Tcomplex& b, const std::complex<double>& db)
+    {
+        const Tdouble* leaves[4] = {&a.my_re, &a.my_im, &b.my_re, &b.my_im};
+        const double   re_w[4]   = {da.real(), -da.imag(), db.real(), -db.imag()};
+        const double   im_w[4]   = {da.imag(),  da.real(), db.imag(),  db.real()};
+        return Tcomplex(
+            Tdouble::custom_node(v.real(), leaves, re_w, 4),
+            Tdouble::custom_node(v.imag(), leaves, im_w, 4));
+    }
+};
+
+// ---------------------------------------------------------------
+// - OPERATORS
+// ---------------------------------------------------------------
+// Free functions, so that doubles, std::complex<double>, Tdoubles and expressions convert to Tcomplex
+inline Tcomplex operator+(const Tcomplex& l_arg, const Tcomplex& r_arg)
+{
+    return Tcomplex(Tdouble(l_arg.real() + r_arg.real()), Tdouble(l_arg.imag() + r_arg.imag()));
+}
+
+inline Tcomplex operator-(const Tcomplex& l_arg, const Tcomplex& r_arg)
+{
+    return Tcomplex(Tdouble(l_arg.real() - r_arg.real()), Tdouble(l_arg.imag() - r_arg.imag()));
+}
+
+inline Tcomplex operator-(const Tcomplex& arg)
+{
+    return Tcomplex(Tdouble(-arg.real()), Tdouble(-arg.imag()));
+}
+
+inline Tcomplex operator*(const Tcomplex& l_arg, const Tcomplex& r_arg)
+{
+    const std::complex<double> l = l_arg.value(), r = r_arg.value();
+    return Tcomplex::holomorphic(l * r, l_arg, r, r_arg, l);
+}
+
+inline Tcomplex operator/(const Tcomplex& l_arg, const Tcomplex& r_arg)
+{
+    const std::complex<double> l = l_arg.value(), r = r_arg.value();
+    const std::complex<double> v = l / r;
+    return Tcomplex::holomorphic(v, l_arg, 1. / r, r_arg, -v / r);
+}
+
+// ---------------------------------------------------------------
+// - FUNCTIONS
+// ---------------------------------------------------------------
+inline Tcomplex exp(const Tcomplex& arg)
+{
+    const std::complex<double> v = std::exp(arg.value());
+    return Tcomplex::holomorphic(v, arg, v);
+}
+
+inline Tcomplex log(const Tcomplex& arg)
+{
+    const std::complex<double> a = arg.value();
+    return Tcomplex::holomorphic(std::log(a), arg, 1. / a);
+}
+
+inline Tcomplex sqrt(const Tcomplex& arg)
+{
+    const std::complex<double> v = std::sqrt(arg.value());
+    return Tcomplex::holomorphic(v, arg, 0.5 / v);
+}
+
+inline Tcomplex pow(const Tcomplex& base, const double expo)
+{
+    const std::complex<double> a = base.value();
+    const std::complex<double> v = std::pow(a, expo);
+    return Tcomplex::holomorphic(v, base, expo * v / a);
+}
+
+inline Tcomplex pow(const Tcomplex& base, const Tcomplex& expo)
+{
+    const std::complex<double> a = base.value(), b = expo.value();
+    const std::complex<double> v = std::pow(a, b);
+    return Tcomplex::holomorphic(v, base, b * v / a, expo, std::log(a) * v);
+}
+
+// Real base, e.g. pow(1. + jump_mean, 1i * om)
+template <class E>
+inline Tcomplex pow(const Texpr<E>& base, const Tcomplex& expo)
+{
+    const Tdouble              a = base;
+    const std::complex<double> b = expo.value();
+    const std::complex<double> v = std::pow(a.get_value(), b);
+    return Tcomplex::holomorphic(v, a, b * v / a.get_value(), expo, std::log(a.get_value()) * v);
+}
+
+inline Tdouble Re(const Tcomplex& arg)
+{
+    return arg.real();
+}
+
+#endif
@@ -3,98 +3,99 @@
 
 // STL includes
 #include "math.h"
+#include <array>
 
 // user includes
 #include "Tape.hpp"
-#include "Gaussian.hpp"
+#include "Texpr.hpp"
 
 // Taped double class. Acts as a double but is instrumented to record the DAG created when used instead of double.
 // Can be propagated to calculate derived values of previous Tdoubles, either to start or to a marked Tdouble 
 // for checkpointing.
-// Information is accessed through the Node (see Node.hpp) member that holds the corresponding adjoint, pointers to child nodes 
-// (or Tdoubles) and the partial derivatives. These are stored on Tape (see Tape.hpp), using the container ListArray (see ListArray.hpp)
+// Information is accessed through the index of the Tdouble's node on Tape (see Tape.hpp), which holds the
+// corresponding adjoint, the child node ids and the partial derivatives in parallel arrays, using the 
+// container List_array (see List_array.hpp)
 // 
-// Leafs in the DAG are initialized by the standard CTOR 'Tdouble someTdouble(double(someValue));'
-// Tdoubles constructed from other Tdoubles can be assigned like doubles. 
-class Tdouble{
+// Tdoubles are either active (on tape) or passive (constants not depending on any input, not on tape).
+// Leafs in the DAG (inputs) are initialized by 'Tdouble someTdouble(double(someValue)); someTdouble.put_on_tape();'
+// Tdoubles constructed from doubles are passive and cost nothing on tape. Operations on passive Tdoubles 
+// only are computed as plain doubles. 
+// Tdoubles constructed from other Tdoubles can be assigned like doubles. Arithmetic on Tdoubles builds 
+// expressions (see Texpr.hpp), recording one node per assignment instead of one per operation.
+class Tdouble : public Texpr<Tdouble>
+{
 // Private members  
 private:
     double my_value;
-    Node* my_node;
+    Tape::index_t my_index = Tape::passive_index;
 
 // Public members
 public:
-    static Tape* tape;
+    // tape of the calling thread (see Parallel.hpp)
+    static thread_local Tape* tape;
 
 // Member functions  
 public:
     // CTORS
     Tdouble(){};
-    Tdouble(double value_)           : my_value(value_){my_node = tape->record_node(0);}
-    Tdouble(double value_, size_t N) : my_value(value_){my_node = tape->record_node(N);}
+    Tdouble(double value_) : my_value(value_){}
 
-    // Assignment operator - Recording the Leaf Node on tape   
+    // Assignment operator - the Tdouble becomes passive   
     Tdouble& operator=(const double val)
     {
-		my_value = val;                     // store value
-		my_node = tape->record_node(0);     // store address for node on tape
+		my_value = val;                         // store value
+		my_index = Tape::passive_index;         // no node on tape
         return *this;
     }
 
+    // Makes the Tdouble an input - Recording the Leaf Node on tape
+    void put_on_tape()
+    {
+        my_index = tape->record_node();
+#ifdef TAPE_STATS
+        tape->count_op(tape_ops::leaf);
+#endif
+    }
+
+    bool is_active() const {return my_index != Tape::passive_index;}
+
     // Explicit conversion to double 
     explicit operator double&()      {return my_value;}
     explicit operator double() const {return my_value;}
 
     // Getters
-    double& get_value()       {return my_value;} 
-    double  get_value() const {return my_value;}
-    Node&   get_node()        {return *my_node;}
+    double&       get_value()       {return my_value;} 
+    double        get_value() const {return my_value;}
+    Tape::index_t get_index() const {return my_index;}
     
-    // Access to Node's members 
-    double&  get_adjoint() const {return my_node->get_adjoint();}
-    double*  weights()           {return my_node->get_weights();}
-    double** child_adjoint()     {return my_node->get_child_adjoint();}
+    // Access to the node's adjoint (0 for passive Tdoubles)
+    double&  get_adjoint() const {return tape->get_adjoint(my_index);}
 
     // set mark in tape at the CURRENT position 
     static void set_mark(){tape->mark_tape();}
     static void set_to_mark(){tape->set_to_mark();}
 
-    
+    // nested marks on top of the mark (see Tape::push_mark())
+    static void push_mark(){tape->push_mark();}
+    static void pop_mark(){tape->pop_mark();}
+    static void set_to_top_mark(){tape->set_to_top_mark();}
+
 // ---------------------------------------------------------------
 // - PROPAGATION  
 // ---------------------------------------------------------------
 private:
-    // Main machine for propagating Tdoubles/nodes.
-    // Takes 2 iterators as input and propagates through the tape between these.  
-    void propagate(Tape::iterator it_from, Tape::iterator it_to, bool set_adjoint = false)
-    {   
-        if (set_adjoint)
-        {
-            it_from->set_adjoint_to_1();
-        }
-        
-        ++it_from; // match end() for use of reverse iterators
-        auto rbegin = std::make_reverse_iterator<containers::List_array<Node, LA_node_size>
-            ::iterator>(it_from);
-        
-        auto rend   = std::make_reverse_iterator<containers::List_array<Node, LA_node_size>
-            ::iterator>(it_to);
-
-        // 'std::for_each' dereferences the iterator, when input is given to the lambda function.
-        // This means we dont dereference by  '->' but simply call '.' instead.
-        std::for_each(rbegin, rend, [&](auto& some_node) {some_node.propagate_node();});
-    }
-
-    // Propagate from current Tdouble to iterator given 
-    void propagate_to(Tape::iterator it_to)
+    // Propagate from current Tdouble to node given 
+    void propagate_to(const size_t to)
     {
-        propagate(tape->find(get_node()), it_to, true);
+        if (!is_active()) return;
+        get_adjoint() = 1;
+        tape->propagate(my_index, to);
     }
 
 public:
     //Propagate from current Tdouble to first Tdouble
     void propagate_to_start(){
-        propagate_to(tape->begin());
+        propagate_to(0);
     }
 
     //Propagate from current Tdouble to marked Tdouble
@@ -104,406 +105,191 @@ public:
             std::__throw_runtime_error("Tape is not marked!");
         }
         
-        propagate_to(tape->marked_it());
+        propagate_to(tape->mark_nodes());
     }
 
     //Propagate from marked Tdouble to first Tdouble
-    void propagate_from_mark_to_start(){
+    static void propagate_from_mark_to_start(){
         if (!tape->check_for_mark())
         {
             std::__throw_runtime_error("Tape is not marked!");
         }
-        propagate(--tape->marked_it(), tape->begin(), false);
+        if (tape->mark_nodes()) tape->propagate(tape->mark_nodes() - 1, 0);
     }
 
-// ---------------------------------------------------------------
-// - OVERLOADING of operators etc.  
-// ---------------------------------------------------------------
-
-    // Overload of the +/- operators 
-    Tdouble operator-() const { return 0.0 - *this;}
-    Tdouble operator+() const { return *this;}
+    //Propagate from the last Tdouble to the top mark. Adjoints are seeded by the caller.
+    static void propagate_to_top_mark(){
+        if (!tape->check_for_mark())
+        {
+            std::__throw_runtime_error("Tape is not marked!");
+        }
+        if (tape->nodes() > tape->top_mark_nodes()) tape->propagate(tape->nodes() - 1, tape->top_mark_nodes());
+    }
 
 // ---------------------------------------------------------------
-// - BOOLS
+// - VECTOR MODE PROPAGATION  
 // ---------------------------------------------------------------
-    // <=, >= 
-    inline friend bool operator>=(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg.my_value >= r_arg.my_value; 
-    }
-
-    inline friend bool operator>=(const double& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg >= r_arg.my_value; 
-    }
-
-    inline friend bool operator>=(const Tdouble& l_arg, const double& r_arg)
-    {
-        return r_arg <= l_arg.my_value; 
-    }
-
-    inline friend bool operator<=(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg.my_value <= r_arg.my_value; 
-    }
-
-    inline friend bool operator<=(const double& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg <= r_arg.my_value; 
-    }
-
-    inline friend bool operator<=(const Tdouble& l_arg, const double& r_arg)
-    {
-        return r_arg >= l_arg.my_value; 
-    }
-
-// <, > 
-    inline friend bool operator>(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg.my_value > r_arg.my_value; 
-    }
-
-    inline friend bool operator>(const double& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg > r_arg.my_value; 
-    }
-
-    inline friend bool operator>(const Tdouble& l_arg, const double& r_arg)
-    {
-        return r_arg < l_arg.my_value; 
-    }
-
-    inline friend bool operator<(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg.my_value < r_arg.my_value; 
-    }
-
-    inline friend bool operator<(const double& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg < r_arg.my_value; 
-    }
-
-    inline friend bool operator<(const Tdouble& l_arg, const double& r_arg)
-    {
-        return r_arg > l_arg.my_value; 
-    }
-
-// !=, == 
-    inline friend bool operator!=(const Tdouble& l_arg, const Tdouble& r_arg)
+// Propagates the adjoints of K outputs in one sweep. Lane k is seeded by outputs[k], and 
+// get_adjoint(k) of an input gives the derivative of outputs[k] to it (a row of the Jacobian).
+private:
+    template<size_t K>
+    static void propagate_to(const std::array<Tdouble, K>& outputs, const size_t to)
     {
-        return l_arg.my_value != r_arg.my_value; 
+        bool   active = false;
+        size_t from   = 0;
+        for (size_t k = 0; k < K; ++k)
+        {
+            if (!outputs[k].is_active()) continue;
+            active = true;
+            from   = std::max<size_t>(from, outputs[k].my_index);
+            tape->get_adjoint(outputs[k].my_index, k) = 1;
+        }
+        if (active) tape->propagate_lanes<K>(from, to);
     }
 
-    inline friend bool operator!=(const double& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg != r_arg.my_value; 
-    }
+public:
+    // Access to the node's adjoint in lane k of the vector mode
+    double&  get_adjoint(const size_t lane) const {return tape->get_adjoint(my_index, lane);}
 
-    inline friend bool operator!=(const Tdouble& l_arg, const double& r_arg)
-    {
-        return r_arg != l_arg.my_value; 
-    }
+    // Starts a vector mode recording with K lanes, all lane adjoints are set to 0
+    static void set_lanes(const size_t K){tape->set_lanes(K);}
 
-    inline friend bool operator==(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg.my_value == r_arg.my_value; 
+    //Propagate from K Tdoubles to first Tdouble
+    template<size_t K>
+    static void propagate_to_start(const std::array<Tdouble, K>& outputs){
+        if (tape->lanes() != K) set_lanes(K);
+        propagate_to(outputs, 0);
     }
 
-    inline friend bool operator==(const double& l_arg, const Tdouble& r_arg)
-    {
-        return l_arg == r_arg.my_value; 
+    //Propagate from K Tdoubles to marked Tdouble
+    template<size_t K>
+    static void propagate_to_mark(const std::array<Tdouble, K>& outputs){
+        if (!tape->check_for_mark())
+        {
+            std::__throw_runtime_error("Tape is not marked!");
+        }
+        if (tape->lanes() != K) set_lanes(K);
+        propagate_to(outputs, tape->mark_nodes());
     }
 
-    inline friend bool operator==(const Tdouble& l_arg, const double& r_arg)
-    {
-        return l_arg.my_value == r_arg; 
+    //Propagate K lanes from marked Tdouble to first Tdouble
+    template<size_t K>
+    static void propagate_from_mark_to_start(){
+        if (!tape->check_for_mark())
+        {
+            std::__throw_runtime_error("Tape is not marked!");
+        }
+        if (tape->mark_nodes()) tape->propagate_lanes<K>(tape->mark_nodes() - 1, 0);
     }
 
 // ---------------------------------------------------------------
-// - BINARY OPERATORS
+// - EXPRESSIONS (see Texpr.hpp)  
 // ---------------------------------------------------------------
-    inline friend Tdouble operator+(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        const double val = l_arg.my_value + r_arg.my_value;
-        Tdouble res_Tdouble(val, 2);
-
-        res_Tdouble.weights()[0] = 1;
-        res_Tdouble.weights()[1] = 1;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-
-        return res_Tdouble;
-    }
-
-    inline friend Tdouble operator+(const Tdouble& l_arg, const double& r_arg)
-    {
-        const double val = l_arg.my_value + r_arg;
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = 1;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        return res_Tdouble;
-    }
-
-    inline friend Tdouble operator+(const double& l_arg, const Tdouble& r_arg)
-    {
-        
-        return r_arg + l_arg;
-    }
-
-    inline friend Tdouble operator-(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        const double val = l_arg.my_value - r_arg.my_value;
-        Tdouble res_Tdouble(val, 2);
-
-        res_Tdouble.weights()[0] = 1;
-        res_Tdouble.weights()[1] = -1;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-
-        return res_Tdouble;
-    }
-
-    inline friend Tdouble operator-(const Tdouble& l_arg, const double& r_arg)
-    {
-        const double val = l_arg.my_value - r_arg;
-        Tdouble res_Tdouble(val, 1);
+    static constexpr size_t n_leaves = 1;
 
-        res_Tdouble.weights()[0] = 1;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
+    double value() const {return my_value;}
 
-        return res_Tdouble;
-    }
-
-    inline friend Tdouble operator-(const double& l_arg, const Tdouble& r_arg)
+    // passive leaves are skipped
+    void push_adjoint(Tape::index_t* ids, double* ws, size_t& k, const double adjoint) const
     {
-        const double val = l_arg - r_arg.my_value;
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = -1;
-        res_Tdouble.child_adjoint()[0] = &r_arg.get_adjoint();
-
-        return res_Tdouble;
+        if (!is_active()) return;
+        ids[k]  = my_index;
+        ws[k++] = adjoint;
     }
 
-    // * 
-    inline friend Tdouble operator*(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        const double val = l_arg.my_value * r_arg.my_value;
-        Tdouble res_Tdouble(val, 2);
-
-        res_Tdouble.weights()[0] = r_arg.my_value;
-        res_Tdouble.weights()[1] = l_arg.my_value;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-
-        return res_Tdouble;
-    }
-
-    inline friend Tdouble operator*(const Tdouble& l_arg, const double& r_arg)
-    {
-        const double val = l_arg.my_value * r_arg;
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = r_arg;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-
-        return res_Tdouble;
-    }
+    // operations are counted on the expressions, a Tdouble has none
+    void count_ops(Tape&) const {}
 
-    inline friend Tdouble operator*(const double& l_arg, const Tdouble& r_arg)
-    {
-        //Quick and dirty, derivs still double arg
-        return r_arg * l_arg;
-    }
-
-    // / 
-    inline friend Tdouble operator/(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        const double val = l_arg.my_value / r_arg.my_value;
-        Tdouble res_Tdouble(val, 2);
-
-        res_Tdouble.weights()[0] = 1.0 / r_arg.my_value;
-        res_Tdouble.weights()[1] = (-1.0)*(l_arg.my_value / (r_arg.my_value * r_arg.my_value));
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-
-        return res_Tdouble;
-    }
-
-    inline friend Tdouble operator/(const Tdouble& l_arg, const double& r_arg)
-    {
-        const double val = l_arg.my_value / r_arg;
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = 1.0 / r_arg;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-
-        return res_Tdouble;
-    }
+    // CTOR and assignment from expression - Recording one node for the whole expression
+    template <class E>
+    Tdouble(const Texpr<E>& expr) : my_value(expr.value()) {record(expr.derived());}
 
-    inline friend Tdouble operator/(const double& l_arg, const Tdouble& r_arg)
+    template <class E>
+    Tdouble& operator=(const Texpr<E>& expr)
     {
-        const double val = l_arg / r_arg.my_value;
-        Tdouble res_Tdouble(val, 1);
-        res_Tdouble.weights()[0] = (-1.0)*(l_arg / (r_arg.my_value * r_arg.my_value));
-        res_Tdouble.child_adjoint()[0] = &r_arg.get_adjoint();
-
-        return res_Tdouble;
+        const double val = expr.value();    // expr may refer to this, store value after recording
+        record(expr.derived());
+        my_value = val;
+        return *this;
     }
 
-    // max 
-    inline friend Tdouble max(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        const bool left = l_arg.my_value > r_arg.my_value;
-        Tdouble res_Tdouble(left ? l_arg.my_value : r_arg.my_value, 2);
-        if (left)
-        {
-            res_Tdouble.weights()[0] = 1.0;
-            res_Tdouble.weights()[1] = 0.;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-            res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-        }
-        else
+private:
+    // Records a node with the partials of the expression, one argument per distinct active leaf.
+    // If all leaves are passive nothing is recorded and the Tdouble is passive.
+    template <class E>
+    void record(const E& expr)
+    {
+        Tape::index_t ids[E::n_leaves];
+        double        ws[E::n_leaves];
+        size_t        n = 0;
+        expr.push_adjoint(ids, ws, n, 1.0);
+
+        // Merge repeated leaves, e.g. 'vol * vol'
+        size_t n_distinct = 0;
+        for (size_t i = 0; i < n; ++i)
         {
-            res_Tdouble.weights()[0] = 0.;
-            res_Tdouble.weights()[1] = 1.0;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-            res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
+            size_t j = 0;
+            while (j < n_distinct && ids[j] != ids[i]) ++j;
+            if (j == n_distinct)
+            {
+                ids[n_distinct] = ids[i];
+                ws[n_distinct++] = ws[i];
+            }
+            else
+            {
+                ws[j] += ws[i];
+            }
         }
-        return res_Tdouble;
-    }
 
-    inline friend Tdouble max(const double& l_arg, const Tdouble& r_arg)
-    {
-        const bool left = l_arg > r_arg.my_value;
-        Tdouble res_Tdouble(left ? l_arg : r_arg.my_value, 1);
-        if (left)
-        {
-            res_Tdouble.weights()[0] = 0.;
-            res_Tdouble.child_adjoint()[0] = &r_arg.get_adjoint();
-        }
-        else
+        if (!n_distinct)
         {
-            res_Tdouble.weights()[0] = 1.0;
-            res_Tdouble.child_adjoint()[0] = &r_arg.get_adjoint();
+            my_index = Tape::passive_index;
+            return;
         }
-        return res_Tdouble;  
-    }
 
-    inline friend Tdouble max(const Tdouble& l_arg, const double& r_arg)
-    {
-        const bool left = l_arg.my_value > r_arg;
-        Tdouble res_Tdouble( left ? l_arg.my_value : r_arg, 1);
-        if (left)
-        {
-            res_Tdouble.weights()[0] = 1.0;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        }
-        else
-        {
-            res_Tdouble.weights()[0] = 0.;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        }
-        return res_Tdouble;
-    }
-    //min
-    inline friend Tdouble min(const Tdouble& l_arg, const Tdouble& r_arg)
-    {
-        const bool left = l_arg.my_value < r_arg.my_value;
-        Tdouble res_Tdouble(left ? l_arg.my_value : r_arg.my_value, 2);
-        if (left)
-        {
-            res_Tdouble.weights()[0] = 1.0;
-            res_Tdouble.weights()[1] = 0.;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-            res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-        }
-        else
-        {
-            res_Tdouble.weights()[0] = 0.;
-            res_Tdouble.weights()[1] = 1.0;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-            res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-        }
-        return res_Tdouble;
-    }
-  
-    inline friend Tdouble min(const double& l_arg, const Tdouble& r_arg)
-    {
-        const bool left = l_arg < r_arg.my_value;
-        Tdouble res_Tdouble(left ? l_arg : r_arg.my_value, 1);
-        if (left)
+        my_index = tape->record_node();
+        for (size_t i = 0; i < n_distinct; ++i)
         {
-            res_Tdouble.weights()[0] = 0.;
-            res_Tdouble.child_adjoint()[0] = &r_arg.get_adjoint();
+            tape->push_arg(ws[i], ids[i]);
         }
-        else
-        {
-            res_Tdouble.weights()[0] = 1.0;
-            res_Tdouble.child_adjoint()[0] = &r_arg.get_adjoint();
-        }
-        return res_Tdouble;
+#ifdef TAPE_STATS
+        expr.count_ops(*tape);
+#endif
     }
 
-    inline friend Tdouble min(const Tdouble& l_arg, const double& r_arg)
+public:
+// ---------------------------------------------------------------
+// - CUSTOM NODES
+// ---------------------------------------------------------------
+    // Records one node with precomputed partials on n leaves, e.g. holomorphic functions of Tcomplex
+    // (see Tcomplex.hpp) or a preaccumulated Jacobian row (see Checkpoint.hpp).
+    // Passive leaves and zero partials are skipped, if none is left the result is passive.
+    static Tdouble custom_node(const double value, const Tdouble* const* leaves, const double* partials, const size_t n)
     {
-        const bool left = l_arg.my_value < r_arg;
-        Tdouble res_Tdouble( left ? l_arg.my_value : r_arg, 1);
-        if (left)
+        Tdouble res(value);
+        for (size_t i = 0; i < n; ++i)
         {
-            res_Tdouble.weights()[0] = 1.0;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        }
-        else
-        {
-            res_Tdouble.weights()[0] = 0.;
-            res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
+            if (!leaves[i]->is_active() || partials[i] == 0.) continue;
+            if (!res.is_active())
+            {
+                res.my_index = tape->record_node();
+#ifdef TAPE_STATS
+                tape->count_op(tape_ops::custom);
+#endif
+            }
+            tape->push_arg(partials[i], leaves[i]->my_index);
         }
-        return res_Tdouble;
+        return res;
     }
 
-    // pow,
-    inline friend Tdouble pow(const Tdouble& l_arg, const Tdouble& r_arg)
-	{
-		const double val = pow(l_arg.my_value, r_arg.my_value);
-        Tdouble res_Tdouble(val, 2);
-
-        res_Tdouble.weights()[0] = r_arg.my_value * val / l_arg.my_value;;
-        res_Tdouble.weights()[1] = log(l_arg.my_value) * val;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();
-        res_Tdouble.child_adjoint()[1] = &r_arg.get_adjoint();
-		return res_Tdouble;
-	}
-
-    inline friend Tdouble pow(const Tdouble& l_arg, const double& r_arg)
-	{
-		const double val = pow(l_arg.my_value, r_arg);
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = r_arg * val / l_arg.my_value;;
-        res_Tdouble.child_adjoint()[0] = &l_arg.get_adjoint();	
-        return res_Tdouble;
-	}
-
-    inline friend Tdouble pow(const double& l_arg, const Tdouble& r_arg)
-	{
-		const double val = pow(l_arg, r_arg.my_value);		
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = log(l_arg) * val;
-        res_Tdouble.child_adjoint()[0] = &r_arg.get_adjoint();
-		return res_Tdouble;
-	}
-    
-
 // ---------------------------------------------------------------
 // - UNARY OPERATORS
 // ---------------------------------------------------------------
+    Tdouble operator+() const { return *this;}
 
     // +=, -=, *=, /=
-    Tdouble& operator+=(const Tdouble& arg)
+    template <class E>
+    Tdouble& operator+=(const Texpr<E>& arg)
     {
         *this = *this + arg;
         return *this;
@@ -514,7 +300,8 @@ public:
         return *this;
     }
 
-    Tdouble& operator-=(const Tdouble& arg)
+    template <class E>
+    Tdouble& operator-=(const Texpr<E>& arg)
     {
         *this = *this - arg;
         return *this;
@@ -525,7 +312,8 @@ public:
         return *this;
     }
 
-    Tdouble& operator*=(const Tdouble& arg)
+    template <class E>
+    Tdouble& operator*=(const Texpr<E>& arg)
     {
         *this = *this * arg;
         return *this;
@@ -536,7 +324,8 @@ public:
         return *this;
     }
 
-    Tdouble& operator/=(const Tdouble& arg)
+    template <class E>
+    Tdouble& operator/=(const Texpr<E>& arg)
     {
         *this = *this / arg;
         return *this;
@@ -546,103 +335,5 @@ public:
         *this = *this / arg;
         return *this;
     }
- 
-    // sqrt
-    inline friend Tdouble sqrt(const Tdouble& arg)
-    {
-        const double val = sqrt(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-        res_Tdouble.weights()[0] = 0.5 / val;
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-
-        return res_Tdouble;
-    }
-    
-    // exp
-    inline friend Tdouble exp(const Tdouble& arg)
-    {
-        const double val = exp(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = val;
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-        return res_Tdouble;
-    }
-    
-    // log
-    inline friend Tdouble log(const Tdouble& arg)
-    {
-        const double val = log(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = 1 / arg.my_value;
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-        return res_Tdouble;
-    }
-
-    // abs
-    inline friend Tdouble abs(const Tdouble& arg)
-    {
-        const double val = abs(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = arg.my_value > 0 ? 1.0 : -1.0;
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-        return res_Tdouble;
-    }
-    
-    inline friend Tdouble fabs(const Tdouble& arg)
-    {
-        const double val = fabs(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-
-        
-        res_Tdouble.weights()[0] = arg.my_value > 0 ? 1.0 : -1.0;
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-        return res_Tdouble;
-    } 
-
-    inline friend Tdouble sin(const Tdouble& arg)
-    {
-        const double val = sin(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-        
-        res_Tdouble.weights()[0] = cos(arg.my_value);
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-        return res_Tdouble;
-    }
-
-    inline friend Tdouble cos(const Tdouble& arg)
-    {
-        const double val = cos(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-        
-        res_Tdouble.weights()[0] = -sin(arg.my_value);
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-        return res_Tdouble;
-    }
-
-    // utilized gaussians.hpp normalCDF
-    inline friend Tdouble normalCdf(const Tdouble& arg)
-    {
-        const double val = gaussian::normalCdf(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-        res_Tdouble.weights()[0] = gaussian::normalDens(arg.my_value);
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-
-        return res_Tdouble;
-    }
-
-    // utilized gaussians.hpp normalDens
-    inline friend Tdouble normalDens(const Tdouble& arg)
-    {
-        const double val = gaussian::normalDens(arg.my_value);
-        Tdouble res_Tdouble(val, 1);
-
-        res_Tdouble.weights()[0] = val*arg.my_value;
-        res_Tdouble.child_adjoint()[0] = &arg.get_adjoint();
-        return res_Tdouble;
-    }
-
 };
 #endif
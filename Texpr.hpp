@@ -0,0 +1,327 @@
+#ifndef TEXPR_HPP
+#define TEXPR_HPP
+
+// STL includes
+#include <math.h>
+#include <cstddef>
+#include <type_traits>
+
+// user includes
+#include "Tape.hpp"
+#include "Gaussian.hpp"
+
+// Expression templates for Tdouble (see Tdouble.hpp).
+// Arithmetic on Tdoubles builds an expression object at compile time instead of recording a node per
+// operation. The expression holds the values of all intermediate results, and when it is assigned to a
+// Tdouble a single node is recorded on tape with one partial derivative per distinct Tdouble leaf.
+// E.g. 'x = (a - 0.5 * b * b) * c' records one node with children a, b, c.
+//
+// Every expression E derives from Texpr<E> (CRTP) and provides
+//      value()                       value of the expression
+//      n_leaves                      number of Tdouble leaves in the expression (compile time)
+//      push_adjoint(ids, ws, k, a)   writes leaf node ids and partials (times a) from position k
+//      count_ops(tape)               counts its operations in the tape's histogram (TAPE_STATS)
+
+class Tdouble;
+
+template <class E>
+struct Texpr
+{
+    const E& derived() const {return static_cast<const E&>(*this);}
+    double   value()   const {return derived().value();}
+};
+
+// Tdouble leaves are held by reference, nested expressions and constants by value
+template <class E>
+using Texpr_store = typename std::conditional<std::is_same<E, Tdouble>::value, const Tdouble&, const E>::type;
+
+// Constant (double) in an expression. Has no leaves.
+struct Tconst : public Texpr<Tconst>
+{
+    static constexpr size_t n_leaves = 0;
+    const double my_value;
+
+    Tconst(const double value_) : my_value(value_) {}
+    double value() const {return my_value;}
+    void push_adjoint(Tape::index_t*, double*, size_t&, const double) const {}
+    void count_ops(Tape&) const {}
+};
+
+// ---------------------------------------------------------------
+// - OPERATIONS: value and partial derivatives (v is the value)
+// ---------------------------------------------------------------
+namespace texpr_ops
+{
+    struct Add
+    {
+        static constexpr tape_ops::Op code = tape_ops::add;
+        static double eval(const double l, const double r)                      {return l + r;}
+        static double left(const double, const double, const double)            {return 1.0;}
+        static double right(const double, const double, const double)           {return 1.0;}
+    };
+
+    struct Sub
+    {
+        static constexpr tape_ops::Op code = tape_ops::sub;
+        static double eval(const double l, const double r)                      {return l - r;}
+        static double left(const double, const double, const double)            {return 1.0;}
+        static double right(const double, const double, const double)           {return -1.0;}
+    };
+
+    struct Mul
+    {
+        static constexpr tape_ops::Op code = tape_ops::mul;
+        static double eval(const double l, const double r)                      {return l * r;}
+        static double left(const double, const double r, const double)          {return r;}
+        static double right(const double l, const double, const double)         {return l;}
+    };
+
+    struct Div
+    {
+        static constexpr tape_ops::Op code = tape_ops::div;
+        static double eval(const double l, const double r)                      {return l / r;}
+        static double left(const double, const double r, const double)          {return 1.0 / r;}
+        static double right(const double l, const double r, const double)       {return (-1.0)*(l / (r * r));}
+    };
+
+    struct Pow
+    {
+        static constexpr tape_ops::Op code = tape_ops::pow;
+        static double eval(const double l, const double r)                      {return pow(l, r);}
+        static double left(const double l, const double r, const double v)      {return r * v / l;}
+        static double right(const double l, const double, const double v)      {return log(l) * v;}
+    };
+
+    struct Max
+    {
+        static constexpr tape_ops::Op code = tape_ops::max;
+        static double eval(const double l, const double r)                      {return l > r ? l : r;}
+        static double left(const double l, const double r, const double)        {return l > r ? 1.0 : 0.;}
+        static double right(const double l, const double r, const double)       {return l > r ? 0. : 1.0;}
+    };
+
+    struct Min
+    {
+        static constexpr tape_ops::Op code = tape_ops::min;
+        static double eval(const double l, const double r)                      {return l < r ? l : r;}
+        static double left(const double l, const double r, const double)        {return l < r ? 1.0 : 0.;}
+        static double right(const double l, const double r, const double)       {return l < r ? 0. : 1.0;}
+    };
+
+    struct Neg
+    {
+        static constexpr tape_ops::Op code = tape_ops::neg;
+        static double eval(const double a)                                      {return -a;}
+        static double deriv(const double, const double)                         {return -1.0;}
+    };
+
+    struct Sqrt
+    {
+        static constexpr tape_ops::Op code = tape_ops::sqrt;
+        static double eval(const double a)                                      {return sqrt(a);}
+        static double deriv(const double, const double v)                       {return 0.5 / v;}
+    };
+
+    struct Exp
+    {
+        static constexpr tape_ops::Op code = tape_ops::exp;
+        static double eval(const double a)                                      {return exp(a);}
+        static double deriv(const double, const double v)                       {return v;}
+    };
+
+    struct Log
+    {
+        static constexpr tape_ops::Op code = tape_ops::log;
+        static double eval(const double a)                                      {return log(a);}
+        static double deriv(const double a, const double)                       {return 1 / a;}
+    };
+
+    struct Abs
+    {
+        static constexpr tape_ops::Op code = tape_ops::abs;
+        static double eval(const double a)                                      {return fabs(a);}
+        static double deriv(const double a, const double)                       {return a > 0 ? 1.0 : -1.0;}
+    };
+
+    struct Sin
+    {
+        static constexpr tape_ops::Op code = tape_ops::sin;
+        static double eval(const double a)                                      {return sin(a);}
+        static double deriv(const double a, const double)                       {return cos(a);}
+    };
+
+    struct Cos
+    {
+        static constexpr tape_ops::Op code = tape_ops::cos;
+        static double eval(const double a)                                      {return cos(a);}
+        static double deriv(const double a, const double)                       {return -sin(a);}
+    };
+
+    struct NormalCdf
+    {
+        static constexpr tape_ops::Op code = tape_ops::normalCdf;
+        static double eval(const double a)                                      {return gaussian::normalCdf(a);}
+        static double deriv(const double a, const double)                       {return gaussian::normalDens(a);}
+    };
+
+    struct NormalDens
+    {
+        static constexpr tape_ops::Op code = tape_ops::normalDens;
+        static double eval(const double a)                                      {return gaussian::normalDens(a);}
+        static double deriv(const double a, const double v)                     {return -v*a;}
+    };
+} // namespace texpr_ops
+
+// ---------------------------------------------------------------
+// - EXPRESSION NODES
+// ---------------------------------------------------------------
+template <class OP, class L, class R>
+struct Tbinary_expr : public Texpr<Tbinary_expr<OP, L, R>>
+{
+    static constexpr size_t n_leaves = L::n_leaves + R::n_leaves;
+
+    Texpr_store<L> my_l;
+    Texpr_store<R> my_r;
+    const double   my_value;
+
+    Tbinary_expr(const L& l_, const R& r_) : my_l(l_), my_r(r_), my_value(OP::eval(l_.value(), r_.value())) {}
+
+    double value() const {return my_value;}
+
+    void push_adjoint(Tape::index_t* ids, double* ws, size_t& k, const double adjoint) const
+    {
+        const double l = my_l.value(), r = my_r.value();
+        if (L::n_leaves) my_l.push_adjoint(ids, ws, k, adjoint * OP::left(l, r, my_value));
+        if (R::n_leaves) my_r.push_adjoint(ids, ws, k, adjoint * OP::right(l, r, my_value));
+    }
+
+    void count_ops(Tape& tape) const
+    {
+        tape.count_op(OP::code);
+        my_l.count_ops(tape);
+        my_r.count_ops(tape);
+    }
+};
+
+template <class OP, class A>
+struct Tunary_expr : public Texpr<Tunary_expr<OP, A>>
+{
+    static constexpr size_t n_leaves = A::n_leaves;
+
+    Texpr_store<A> my_a;
+    const double   my_value;
+
+    Tunary_expr(const A& a_) : my_a(a_), my_value(OP::eval(a_.value())) {}
+
+    double value() const {return my_value;}
+
+    void push_adjoint(Tape::index_t* ids, double* ws, size_t& k, const double adjoint) const
+    {
+        my_a.push_adjoint(ids, ws, k, adjoint * OP::deriv(my_a.value(), my_value));
+    }
+
+    void count_ops(Tape& tape) const
+    {
+        tape.count_op(OP::code);
+        my_a.count_ops(tape);
+    }
+};
+
+// ---------------------------------------------------------------
+// - BINARY OPERATORS
+// ---------------------------------------------------------------
+#define TEXPR_BINARY(FUNC, OP)                                                                  \
+    template <class L, class R>                                                                 \
+    inline Tbinary_expr<texpr_ops::OP, L, R> FUNC(const Texpr<L>& l_arg, const Texpr<R>& r_arg) \
+    {                                                                                           \
+        return Tbinary_expr<texpr_ops::OP, L, R>(l_arg.derived(), r_arg.derived());            \
+    }                                                                                           \
+    template <class L>                                                                          \
+    inline Tbinary_expr<texpr_ops::OP, L, Tconst> FUNC(const Texpr<L>& l_arg, const double r_arg)   \
+    {                                                                                           \
+        return Tbinary_expr<texpr_ops::OP, L, Tconst>(l_arg.derived(), Tconst(r_arg));         \
+    }                                                                                           \
+    template <class R>                                                                          \
+    inline Tbinary_expr<texpr_ops::OP, Tconst, R> FUNC(const double l_arg, const Texpr<R>& r_arg)   \
+    {                                                                                           \
+        return Tbinary_expr<texpr_ops::OP, Tconst, R>(Tconst(l_arg), r_arg.derived());         \
+    }
+
+TEXPR_BINARY(operator+, Add)
+TEXPR_BINARY(operator-, Sub)
+TEXPR_BINARY(operator*, Mul)
+TEXPR_BINARY(operator/, Div)
+TEXPR_BINARY(pow, Pow)
+TEXPR_BINARY(max, Max)
+TEXPR_BINARY(min, Min)
+
+#undef TEXPR_BINARY
+
+// ---------------------------------------------------------------
+// - UNARY OPERATORS
+// ---------------------------------------------------------------
+#define TEXPR_UNARY(FUNC, OP)                                                                   \
+    template <class A>                                                                          \
+    inline Tunary_expr<texpr_ops::OP, A> FUNC(const Texpr<A>& arg)                              \
+    {                                                                                           \
+        return Tunary_expr<texpr_ops::OP, A>(arg.derived());                                    \
+    }
+
+TEXPR_UNARY(operator-, Neg)
+TEXPR_UNARY(sqrt, Sqrt)
+TEXPR_UNARY(exp, Exp)
+TEXPR_UNARY(log, Log)
+TEXPR_UNARY(abs, Abs)
+TEXPR_UNARY(fabs, Abs)
+TEXPR_UNARY(sin, Sin)
+TEXPR_UNARY(cos, Cos)
+// utilized gaussians.hpp normalCdf and normalDens
+TEXPR_UNARY(normalCdf, NormalCdf)
+TEXPR_UNARY(normalDens, NormalDens)
+
+#undef TEXPR_UNARY
+
+template <class A>
+inline const Texpr<A>& operator+(const Texpr<A>& arg) {return arg;}
+
+// ---------------------------------------------------------------
+// - BOOLS
+// ---------------------------------------------------------------
+// value comparisons used by the operators below
+namespace texpr_ops
+{
+    inline bool lt(const double l, const double r) {return l <  r;}
+    inline bool gt(const double l, const double r) {return l >  r;}
+    inline bool le(const double l, const double r) {return l <= r;}
+    inline bool ge(const double l, const double r) {return l >= r;}
+    inline bool eq(const double l, const double r) {return l == r;}
+    inline bool ne(const double l, const double r) {return l != r;}
+}
+
+#define TEXPR_COMPARE(FUNC, CMP)                                                                \
+    template <class L, class R>                                                                 \
+    inline bool FUNC(const Texpr<L>& l_arg, const Texpr<R>& r_arg)                              \
+    {                                                                                           \
+        return texpr_ops::CMP(l_arg.value(), r_arg.value());                                    \
+    }                                                                                           \
+    template <class L>                                                                          \
+    inline bool FUNC(const Texpr<L>& l_arg, const double r_arg)                                 \
+    {                                                                                           \
+        return texpr_ops::CMP(l_arg.value(), r_arg);                                            \
+    }                                                                                           \
+    template <class R>                                                                          \
+    inline bool FUNC(const double l_arg, const Texpr<R>& r_arg)                                 \
+    {                                                                                           \
+        return texpr_ops::CMP(l_arg, r_arg.value());                                            \
+    }
+
+TEXPR_COMPARE(operator<,  lt)
+TEXPR_COMPARE(operator>,  gt)
+TEXPR_COMPARE(operator<=, le)
+TEXPR_COMPARE(operator>=, ge)
+TEXPR_COMPARE(operator==, eq)
+TEXPR_COMPARE(operator!=, ne)
+
+#undef TEXPR_COMPARE
+
+#endif
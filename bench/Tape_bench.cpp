@@ -0,0 +1,1314 @@
+// Tape benchmarks. Build from the repository root:
+// g++ bench/Tape_bench.cpp Tape.cpp -o tape_bench -std=c++17 -O2
+// add -DTAPE_STATS for the operation histogram in the tape stats
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <fstream>
+
+#include "../Tdouble.hpp"
+#include "../Seq.hpp"
+#include "../Mrg32k.hpp"
+#include "../Sobol.hpp"
+#include "../Brownian_bridge.hpp"
+#include "../Philox.hpp"
+#include "../MC.hpp"
+#include "../Replay.hpp"
+#include "../Level_sweep.hpp"
+#include "../Dual.hpp"
+
+#define bench_spot_         100.
+#define bench_strike_       110.
+#define bench_mat_          3.
+#define bench_vol_          0.2
+#define bench_mats_steps_   72.
+#define bench_paths_        20000
+
+// Flat local vol surface on the tape with n_spots spot nodes and n_mats maturities
+Surface_results<Tdouble> flat_surface(const size_t n_spots, const double n_mats = bench_mats_steps_)
+{
+    Surface_results<double> res;
+    res.spots = tools::seq(40., 200., n_spots);
+    res.mats  = tools::seq(0., bench_mat_, n_mats);
+    res.iVol  = Matrix<double>(res.mats.size(), res.spots.size());
+    res.lVol  = Matrix<double>(res.mats.size(), res.spots.size());
+    res.iVol.fill(bench_vol_);
+    res.lVol.fill(bench_vol_);
+
+    return Convert_to_Tdouble(res);
+}
+
+// Local vol surface with a skew and a term structure, so that the interpolation slope contributes to delta
+Surface_results<double> skew_surface(const size_t n_spots)
+{
+    Surface_results<double> res;
+    res.spots = tools::seq(40., 200., n_spots);
+    res.mats  = tools::seq(0., bench_mat_, bench_mats_steps_);
+    res.iVol  = Matrix<double>(res.mats.size(), res.spots.size());
+    res.lVol  = Matrix<double>(res.mats.size(), res.spots.size());
+    for (size_t i = 0; i < res.mats.size(); ++i)
+        for (size_t j = 0; j < res.spots.size(); ++j)
+            res.lVol[i][j] = res.iVol[i][j] = bench_vol_ + 0.001 * (bench_spot_ - res.spots[j]) + 0.01 * res.mats[i];
+
+    return res;
+}
+
+// Per path cost of MC_European_CallOption_AAD as the surface grid grows.
+// The surface leaves are recorded before the mark, so the per path reverse 
+// sweep should not depend on the number of spot nodes.
+void bench_propagate_to_mark()
+{
+    std::cout << "propagate_to_mark: per path time vs. surface size" << std::endl;
+    std::cout << std::setw(10) << "spots" << std::setw(14) << "leaves" << std::setw(16) << "us/path" << std::endl;
+
+    for (size_t n_spots : {33, 132, 528, 2112, 8448})
+    {
+        Tdouble::tape->clear();
+        Tdouble spot = bench_spot_, strike = bench_strike_, r = 0., q = 0., mat = bench_mat_;
+        for (Tdouble* input : {&spot, &strike, &r, &q, &mat}) input->put_on_tape();
+        auto surface = flat_surface(n_spots);
+
+        RNG::Mrg32k_RNG rng;
+        auto start = std::chrono::steady_clock::now();
+        MC_European_CallOption_AAD(spot, r, q, strike, mat, surface, rng, bench_paths_);
+        auto stop  = std::chrono::steady_clock::now();
+
+        const double us = std::chrono::duration<double, std::micro>(stop - start).count();
+        std::cout << std::setw(10) << n_spots 
+                  << std::setw(14) << 2 * n_spots * surface.mats.size()
+                  << std::setw(16) << us / bench_paths_ << std::endl;
+    }
+}
+
+// Bytes of the same recording in the former layout: a Node (n, adjoint, pointer to weights,
+// pointer to child adjoint addresses) per node and a weight and a child adjoint address per argument.
+size_t legacy_bytes(const size_t n_nodes, const size_t n_args)
+{
+    return n_nodes * (sizeof(size_t) + sizeof(double) + sizeof(double*) + sizeof(double**)) 
+        + n_args * (sizeof(double) + sizeof(double*));
+}
+
+template<typename Pricer>
+void report_tape(const std::string& name, Pricer pricer)
+{
+    Tdouble::tape->clear();
+    Tdouble spot = bench_spot_, strike = bench_strike_, r = 0., q = 0., mat = bench_mat_;
+    for (Tdouble* input : {&spot, &strike, &r, &q, &mat}) input->put_on_tape();
+    auto surface = flat_surface(33);
+
+    auto start = std::chrono::steady_clock::now();
+    pricer(spot, strike, r, q, mat, surface);
+    auto stop  = std::chrono::steady_clock::now();
+
+    // per path recording is everything after the mark
+    const Tape& tape = *Tdouble::tape;
+    const size_t nodes = tape.peak_nodes() - tape.mark_nodes();
+    const size_t args  = tape.peak_args() - tape.mark_args();
+
+    std::cout << std::setw(10) << name 
+              << std::setw(10) << nodes
+              << std::setw(10) << args
+              << std::setw(14) << legacy_bytes(nodes, args)
+              << std::setw(14) << Tape::bytes(nodes, args)
+              << std::setw(12) << std::chrono::duration<double, std::micro>(stop - start).count() / bench_paths_ 
+              << std::endl;
+}
+
+// Tape size per path, bytes in the former Node layout vs. the structure of arrays layout, and time per path.
+void bench_tape_layout()
+{
+    std::cout << "tape layout: bytes per path recording" << std::endl;
+    std::cout << std::setw(10) << "pricer" << std::setw(10) << "nodes" << std::setw(10) << "args" 
+              << std::setw(14) << "Node bytes" << std::setw(14) << "SoA bytes" << std::setw(12) << "us/path" << std::endl;
+
+    report_tape("call", [](Tdouble& spot, Tdouble& strike, Tdouble& r, Tdouble& q, Tdouble& mat, Surface_results<Tdouble>& surface)
+    {
+        RNG::Mrg32k_RNG rng;
+        MC_European_CallOption_AAD(spot, r, q, strike, mat, surface, rng, bench_paths_);
+    });
+
+    report_tape("autocall", [](Tdouble& spot, Tdouble&, Tdouble& r, Tdouble& q, Tdouble&, Surface_results<Tdouble>& surface)
+    {
+        Tdouble coupon = 10., upper = 120., lower = 50., anchor = 100.;
+        for (Tdouble* input : {&coupon, &upper, &lower, &anchor}) input->put_on_tape();
+        std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+        RNG::Mrg32k_RNG rng;
+        MC_Auto_Callable_AAD(spot, r, q, coupon, upper, lower, anchor, times, surface, rng, bench_paths_, 5.);
+    });
+}
+
+// Partial of a recorded expression against a central difference of the double function
+template<typename Recorded, typename Plain>
+void report_partial(const std::string& name, Recorded recorded, Plain plain, const double x, double& max_error)
+{
+    Tdouble::tape->clear();
+    Tdouble arg = x;
+    arg.put_on_tape();
+    Tdouble res = recorded(arg);
+    res.propagate_to_start();
+
+    const double h  = 1e-5 * std::max(1., fabs(x));
+    const double fd = (plain(x + h) - plain(x - h)) / (2 * h);
+    const double error = fabs(arg.get_adjoint() - fd) / std::max(1., fabs(fd));
+    max_error = std::max(max_error, error);
+    std::cout << std::setw(12) << name << std::setw(8) << x << std::setw(16) << arg.get_adjoint()
+              << std::setw(16) << fd << std::setw(12) << error << std::endl;
+}
+
+// Partials of the expression template operations (see Texpr.hpp) against central differences of the double
+// functions, throws on a mismatch
+void bench_expressions()
+{
+    std::cout << "expressions: AAD vs. central differences" << std::endl;
+    std::cout << std::setw(12) << "op" << std::setw(8) << "x" << std::setw(16) << "AAD"
+              << std::setw(16) << "FD" << std::setw(12) << "error" << std::endl;
+
+    double max_error = 0;
+    for (const double x : {-1.3, 0.7})
+    {
+        report_partial("normalDens", [](const Tdouble& a) -> Tdouble {return normalDens(a);}, 
+            [](const double a) {return gaussian::normalDens(a);}, x, max_error);
+        report_partial("normalCdf", [](const Tdouble& a) -> Tdouble {return normalCdf(a);}, 
+            [](const double a) {return gaussian::normalCdf(a);}, x, max_error);
+        report_partial("exp", [](const Tdouble& a) -> Tdouble {return exp(a * a);}, 
+            [](const double a) {return ::exp(a * a);}, x, max_error);
+        report_partial("sin cos", [](const Tdouble& a) -> Tdouble {return sin(a) * cos(2. * a);}, 
+            [](const double a) {return ::sin(a) * ::cos(2. * a);}, x, max_error);
+        report_partial("abs", [](const Tdouble& a) -> Tdouble {return -abs(a) / (1. + a * a);}, 
+            [](const double a) {return -::fabs(a) / (1. + a * a);}, x, max_error);
+        report_partial("max min", [](const Tdouble& a) -> Tdouble {return max(a, 0.) - min(a * a, 1.);}, 
+            [](const double a) {return std::max(a, 0.) - std::min(a * a, 1.);}, x, max_error);
+    }
+    for (const double x : {0.3, 2.5})
+    {
+        report_partial("log sqrt", [](const Tdouble& a) -> Tdouble {return log(a) * sqrt(a);}, 
+            [](const double a) {return ::log(a) * ::sqrt(a);}, x, max_error);
+        report_partial("pow", [](const Tdouble& a) -> Tdouble {return pow(a, a) + pow(2., a) + pow(a, 1.5);}, 
+            [](const double a) {return ::pow(a, a) + ::pow(2., a) + ::pow(a, 1.5);}, x, max_error);
+    }
+    // normalCdf is an approximation (error about 1e-7), its recorded partial is the exact density
+    if (!(max_error < 1e-6)) std::__throw_runtime_error("bench_expressions: AAD and central differences disagree");
+    Tdouble::tape->clear();
+}
+
+// Strike ladder of 4 calls: one vector mode sweep per path vs. one pricing per strike
+void bench_vector_mode()
+{
+    std::cout << "vector mode: 4 strike call ladder" << std::endl;
+    const std::array<double, 4> ladder = {90., 100., 110., 120.};
+
+    Tdouble::tape->clear();
+    Tdouble spot = bench_spot_, r = 0., q = 0., mat = bench_mat_;
+    for (Tdouble* input : {&spot, &r, &q, &mat}) input->put_on_tape();
+    std::array<Tdouble, 4> strikes;
+    for (size_t k = 0; k < 4; ++k) {strikes[k] = ladder[k]; strikes[k].put_on_tape();}
+    auto surface = flat_surface(33);
+
+    RNG::Mrg32k_RNG rng;
+    auto start = std::chrono::steady_clock::now();
+    MC_European_CallOption_Ladder_AAD(spot, r, q, strikes, mat, surface, rng, bench_paths_);
+    auto stop  = std::chrono::steady_clock::now();
+    const double us_vector = std::chrono::duration<double, std::micro>(stop - start).count() / bench_paths_;
+
+    double us_scalar = 0;
+    for (size_t k = 0; k < 4; ++k)
+    {
+        Tdouble::tape->clear();
+        Tdouble spot = bench_spot_, strike = ladder[k], r = 0., q = 0., mat = bench_mat_;
+        for (Tdouble* input : {&spot, &strike, &r, &q, &mat}) input->put_on_tape();
+        auto surface = flat_surface(33);
+
+        RNG::Mrg32k_RNG rng;
+        auto start = std::chrono::steady_clock::now();
+        MC_European_CallOption_AAD(spot, r, q, strike, mat, surface, rng, bench_paths_);
+        auto stop  = std::chrono::steady_clock::now();
+        us_scalar += std::chrono::duration<double, std::micro>(stop - start).count() / bench_paths_;
+    }
+
+    std::cout << std::setw(20) << "4 scalar pricings" << std::setw(12) << us_scalar << " us/path" << std::endl;
+    std::cout << std::setw(20) << "vector mode K=4"   << std::setw(12) << us_vector << " us/path" << std::endl;
+}
+
+// Gamma ladder of Black_scholes by forward over reverse (hessian_vector() in Dual.hpp, direction spot):
+// delta, gamma and vanna in one recording and one 2 lane sweep per spot, vs. the closed forms and central
+// finite differences of the double pricer. The FD carry the error of the normalCdf approximation (~1e-7),
+// the bench fails if forward over reverse and the closed forms disagree.
+void bench_second_order()
+{
+    std::cout << "second order: Black_scholes gamma ladder, forward over reverse vs. FD" << std::endl;
+    std::cout << std::setw(8) << "spot" << std::setw(14) << "gamma" << std::setw(14) << "gamma FD" 
+              << std::setw(14) << "vanna" << std::setw(14) << "vanna FD" << std::endl;
+
+    const double strike = bench_strike_, vol = bench_vol_, mat = bench_mat_;
+    auto bs = [](const auto& x) {return Black_scholes(x[0], x[1], x[2], x[3]);};
+    auto price = [&](const double spot, const double vol_) {return Black_scholes(spot, strike, vol_, mat);};
+    const auto spots = tools::seq(60., 160., 11.);
+
+    double max_error = 0, us_fwd_rev = 0, us_fd = 0;
+    for (const double spot : spots)
+    {
+        Tdouble::tape->clear();
+        auto start = std::chrono::steady_clock::now();
+        const Second_order<4> res = hessian_vector<4>(bs, {spot, strike, vol, mat}, {1., 0., 0., 0.});
+        auto mid   = std::chrono::steady_clock::now();
+        const double h = 1.e-2, k = 1.e-4;
+        const double gamma_fd = (price(spot + h, vol) - 2. * price(spot, vol) + price(spot - h, vol)) / (h * h);
+        const double vanna_fd = (price(spot + h, vol + k) - price(spot + h, vol - k) - price(spot - h, vol + k) + price(spot - h, vol - k)) 
+                                / (4. * h * k);
+        auto stop  = std::chrono::steady_clock::now();
+        us_fwd_rev += std::chrono::duration<double, std::micro>(mid - start).count();
+        us_fd      += std::chrono::duration<double, std::micro>(stop - mid).count();
+
+        // closed forms: gamma = phi(d1) / (spot vol sqrt(mat)), vanna = -phi(d1) d2 / vol
+        const double std = vol * sqrt(mat);
+        const double d1  = (log(spot / strike) + 0.5 * std * std) / std;
+        const double d2  = d1 - std;
+        const double gamma = gaussian::normalDens(d1) / (spot * std);
+        const double vanna = -gaussian::normalDens(d1) * d2 / vol;
+        max_error = std::max({max_error, std::abs(res.hessian_v[0] - gamma) / gamma, std::abs(res.hessian_v[2] - vanna) / std::max(1., std::abs(vanna)),
+                              std::abs(res.gradient[0] - gaussian::normalCdf(d1))});
+
+        std::cout << std::setw(8) << spot << std::setw(14) << res.hessian_v[0] << std::setw(14) << gamma_fd 
+                  << std::setw(14) << res.hessian_v[2] << std::setw(14) << vanna_fd << std::endl;
+    }
+    std::cout << "max relative error vs. closed forms " << max_error << "; us per spot: forward over reverse " 
+              << us_fwd_rev / spots.size() << ", FD (9 prices, gamma and vanna only) " << us_fd / spots.size() << std::endl;
+    if (!(max_error < 1.e-10)) std::__throw_runtime_error("bench_second_order: forward over reverse and the closed forms disagree");
+}
+
+// Gamma and the cross gammas to the local vols of an MC call on skew_surface() by forward over reverse
+// through the local vol path (MC_European_CallOption_Gamma_AAD, payoff smoothed over eps): one run, vs.
+// central differences in spot of delta and the local vol vegas (lane 0) of two runs on the same paths.
+// Timed against the bump it replaces, two runs of the AAD pricer MC_European_CallOption_AAD: the Dual path
+// records every operation where the AAD pricer records one fused node per step, and is 3-4x slower.
+// The bench fails if forward over reverse and the differences disagree.
+void bench_second_order_mc()
+{
+    const size_t paths = bench_paths_ / 10;
+    // spot between two nodes of the surface grid, on a node interp has a kink and the FD are one sided
+    const double spot_0 = 102.5, eps = 1., h = 1.e-4;
+    std::cout << "second order: MC call, forward over reverse through the local vol path vs. FD of the vegas" << std::endl;
+
+    struct Greeks {double price, delta, gamma; Surface_results<double> first, second;};
+    auto run = [&](const double spot_)
+    {
+        Tdouble::tape->clear();
+        Tdouble spot = spot_, strike = bench_strike_, r = 0., q = 0., mat = bench_mat_;
+        for (Tdouble* input : {&spot, &strike, &r, &q, &mat}) input->put_on_tape();
+        Surface_results<Tdouble> surface = Convert_to_Tdouble(skew_surface(33));
+        RNG::Mrg32k_RNG rng;
+        Greeks greeks;
+        greeks.price  = MC_European_CallOption_Gamma_AAD(spot, r, q, strike, mat, surface, rng, paths, eps);
+        greeks.delta  = spot.get_adjoint(0);
+        greeks.gamma  = spot.get_adjoint(1);
+        greeks.first  = Get_adjoints_SR(surface, 0);
+        greeks.second = Get_adjoints_SR(surface, 1);
+        return greeks;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    const Greeks greeks = run(spot_0);
+    auto stop  = std::chrono::steady_clock::now();
+    const Greeks up = run(spot_0 + h), down = run(spot_0 - h);
+
+    const double gamma_fd = (up.delta - down.delta) / (2. * h);
+    double max_cross = 0, max_error = std::abs(greeks.gamma - gamma_fd);
+    for (size_t i = 0; i < greeks.second.lVol.get_rows(); ++i)
+    {
+        for (size_t j = 0; j < greeks.second.lVol.get_cols(); ++j)
+        {
+            const double cross_fd = (up.first.lVol[i][j] - down.first.lVol[i][j]) / (2. * h);
+            max_cross = std::max(max_cross, std::abs(greeks.second.lVol[i][j]));
+            max_error = std::max(max_error, std::abs(greeks.second.lVol[i][j] - cross_fd));
+        }
+    }
+
+    // the bump it replaces: central differences of two runs of the AAD pricer
+    auto bump_start = std::chrono::steady_clock::now();
+    for (const double spot_ : {spot_0 + h, spot_0 - h})
+    {
+        Tdouble::tape->clear();
+        Tdouble spot = spot_, strike = bench_strike_, r = 0., q = 0., mat = bench_mat_;
+        for (Tdouble* input : {&spot, &strike, &r, &q, &mat}) input->put_on_tape();
+        Surface_results<Tdouble> surface = Convert_to_Tdouble(skew_surface(33));
+        RNG::Mrg32k_RNG rng;
+        MC_European_CallOption_AAD(spot, r, q, strike, mat, surface, rng, paths);
+    }
+    auto bump_stop = std::chrono::steady_clock::now();
+
+    std::cout << std::setw(12) << "price" << std::setw(12) << "delta" << std::setw(12) << "gamma" << std::setw(12) << "gamma FD" 
+              << std::setw(16) << "max |cross|" << std::setw(16) << "max |d FD|" << std::endl;
+    std::cout << std::setw(12) << greeks.price << std::setw(12) << greeks.delta << std::setw(12) << greeks.gamma << std::setw(12) << gamma_fd
+              << std::setw(16) << max_cross << std::setw(16) << max_error << std::endl;
+    std::cout << "ms: forward over reverse " << std::chrono::duration<double, std::milli>(stop - start).count() 
+              << ", two AAD pricings " << std::chrono::duration<double, std::milli>(bump_stop - bump_start).count() << std::endl;
+    if (!(max_error < 1.e-8 * std::max(1., max_cross))) std::__throw_runtime_error("bench_second_order_mc: forward over reverse and FD of the vegas disagree");
+}
+
+// Auto callable on a daily grid: full per path tape vs. binomial checkpointing under memory budgets.
+// Price and delta must not depend on the budget, the per path tape must stay within it.
+void bench_checkpointing()
+{
+    std::cout << "checkpointing: daily autocall, per path tape vs. budget" << std::endl;
+    std::cout << std::setw(10) << "snapshots" << std::setw(12) << "budget" << std::setw(12) << "peak nodes" 
+              << std::setw(12) << "price" << std::setw(12) << "delta" << std::setw(12) << "us/path" << std::endl;
+
+    const size_t paths = bench_paths_ / 10;
+    std::vector<Checkpoint_budget> budgets = {{0, 1 << 30}, {16, 4000}, {8, 1000}, {4, 250}, {2, 50}};
+    for (const Checkpoint_budget& budget : budgets)
+    {
+        Tdouble::tape->clear();
+        Tdouble spot = bench_spot_, r = 0., q = 0., coupon = 10., upper = 120., lower = 50., anchor = 100.;
+        for (Tdouble* input : {&spot, &r, &q, &coupon, &upper, &lower, &anchor}) input->put_on_tape();
+        std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+        auto surface = flat_surface(33, 252 * bench_mat_);
+
+        RNG::Mrg32k_RNG rng;
+        auto start = std::chrono::steady_clock::now();
+        const double price = MC_Auto_Callable_Checkpointed_AAD(
+            spot, r, q, coupon, upper, lower, anchor, times, surface, rng, paths, 5., budget);
+        auto stop  = std::chrono::steady_clock::now();
+
+        const Tape& tape = *Tdouble::tape;
+        std::cout << std::setw(10) << budget.snapshots 
+                  << std::setw(12) << budget.tape_nodes
+                  << std::setw(12) << tape.peak_nodes() - tape.mark_nodes()
+                  << std::setw(12) << price
+                  << std::setw(12) << spot.get_adjoint()
+                  << std::setw(12) << std::chrono::duration<double, std::micro>(stop - start).count() / paths 
+                  << std::endl;
+    }
+}
+
+// Repeated pricings in one process: blocks freed by clear() are reused, 
+// only the first call allocates (and touches) the tape memory
+void bench_repeated_pricing()
+{
+    std::cout << "repeated pricing: call, 8448 spot surface" << std::endl;
+    Tdouble::tape->set_block_sizes(LA_node_size, LA_dou_size);
+    for (size_t run = 0; run < 4; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Tdouble::tape->clear();
+        Tdouble spot = bench_spot_, strike = bench_strike_, r = 0., q = 0., mat = bench_mat_;
+        for (Tdouble* input : {&spot, &strike, &r, &q, &mat}) input->put_on_tape();
+        auto surface = flat_surface(8448);
+
+        RNG::Mrg32k_RNG rng;
+        MC_European_CallOption_AAD(spot, r, q, strike, mat, surface, rng, bench_paths_ / 10);
+        auto stop  = std::chrono::steady_clock::now();
+
+        std::cout << std::setw(10) << "run " << run 
+                  << std::setw(12) << std::chrono::duration<double, std::milli>(stop - start).count() << " ms"
+                  << std::setw(10) << Tdouble::tape->stats().allocated_bytes / (1 << 20) << " MB allocated" << std::endl;
+    }
+}
+
+// Big tape (8M nodes, 24M arguments) on the heap vs. an mmap arena: normal pages released on clear(),
+// and transparent huge pages kept over clear()
+template<typename Setup>
+void report_big_tape(const std::string& name, Setup setup)
+{
+    setup();
+    for (size_t run = 0; run < 2; ++run)
+    {
+        Tdouble::tape->clear();
+        auto start = std::chrono::steady_clock::now();
+        Tdouble a = 1., b = 0.001, x = 1.;
+        for (Tdouble* input : {&a, &b, &x}) input->put_on_tape();
+        for (size_t i = 0; i < (size_t(1) << 23); ++i) x = x * a + b;
+        auto mid  = std::chrono::steady_clock::now();
+        x.propagate_to_start();
+        auto stop = std::chrono::steady_clock::now();
+
+        std::cout << std::setw(16) << name << std::setw(6) << run
+                  << std::setw(14) << std::chrono::duration<double, std::milli>(mid - start).count()
+                  << std::setw(14) << std::chrono::duration<double, std::milli>(stop - mid).count() << std::endl;
+    }
+}
+
+void bench_arena()
+{
+    std::cout << "arena: 8M node tape, ms" << std::endl;
+    std::cout << std::setw(16) << "allocator" << std::setw(6) << "run" << std::setw(14) << "record" << std::setw(14) << "propagate" << std::endl;
+
+    containers::Mmap_arena arena(size_t(1) << 30, containers::Huge_pages::none);
+    containers::Mmap_arena huge_arena(size_t(1) << 30, containers::Huge_pages::transparent, false);
+
+    report_big_tape("heap", [](){Tdouble::tape->set_allocator(containers::Heap_allocator::instance());});
+
+    // blocks kept for reuse after clear(), and after shrink()
+    Tdouble::tape->clear();
+    std::cout << std::setw(16) << "heap cleared" << std::setw(10) << Tdouble::tape->stats().free_blocks << " free blocks"
+              << std::setw(10) << Tdouble::tape->stats().allocated_bytes / (1 << 20) << " MB allocated" << std::endl;
+    Tdouble::tape->shrink();
+    std::cout << std::setw(16) << "heap shrunk" << std::setw(10) << Tdouble::tape->stats().free_blocks << " free blocks"
+              << std::setw(10) << Tdouble::tape->stats().allocated_bytes / (1 << 20) << " MB allocated" << std::endl;
+
+    report_big_tape("mmap", [&](){Tdouble::tape->set_allocator(arena);});
+    report_big_tape("mmap THP keep", [&](){Tdouble::tape->set_allocator(huge_arena);});
+
+    // the arenas go out of scope
+    Tdouble::tape->set_allocator(containers::Heap_allocator::instance());
+}
+
+// Record once, replay many vs. recording every path: price, greeks and time per path
+template<typename Pricer>
+void report_replay(const std::string& name, Pricer pricer)
+{
+    Tdouble::tape->clear();
+    Tdouble spot = bench_spot_, strike = bench_strike_, r = 0.01, q = 0., mat = bench_mat_;
+    for (Tdouble* input : {&spot, &strike, &r, &q, &mat}) input->put_on_tape();
+    auto surface = flat_surface(33);
+
+    auto start = std::chrono::steady_clock::now();
+    const double price = pricer(spot, strike, r, q, mat, surface);
+    auto stop  = std::chrono::steady_clock::now();
+
+    double vega = 0;
+    for (auto& vol : surface.lVol) vega += vol.get_adjoint();
+
+    std::cout << std::setw(16) << name 
+              << std::setw(12) << price
+              << std::setw(12) << spot.get_adjoint()
+              << std::setw(12) << r.get_adjoint()
+              << std::setw(12) << vega
+              << std::setw(12) << std::chrono::duration<double, std::micro>(stop - start).count() / bench_paths_ 
+              << std::endl;
+}
+
+void bench_replay()
+{
+    std::cout << "replay: one recorded path replayed vs. tape per path" << std::endl;
+    std::cout << std::setw(16) << "pricer" << std::setw(12) << "price" << std::setw(12) << "delta" 
+              << std::setw(12) << "rho" << std::setw(12) << "vega" << std::setw(12) << "us/path" << std::endl;
+
+    auto autocall = [](auto method)
+    {
+        return [method](Tdouble& spot, Tdouble&, Tdouble& r, Tdouble& q, Tdouble&, Surface_results<Tdouble>& surface)
+        {
+            Tdouble coupon = 10., upper = 120., lower = 50., anchor = 100.;
+            for (Tdouble* input : {&coupon, &upper, &lower, &anchor}) input->put_on_tape();
+            std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+            RNG::Mrg32k_RNG rng;
+            return method(spot, r, q, coupon, upper, lower, anchor, times, surface, rng, bench_paths_, 5.);
+        };
+    };
+
+    report_replay("call tape", [](Tdouble& spot, Tdouble& strike, Tdouble& r, Tdouble& q, Tdouble& mat, Surface_results<Tdouble>& surface)
+    {
+        RNG::Mrg32k_RNG rng;
+        return MC_European_CallOption_AAD(spot, r, q, strike, mat, surface, rng, bench_paths_);
+    });
+    report_replay("call replay", [](Tdouble& spot, Tdouble& strike, Tdouble& r, Tdouble& q, Tdouble& mat, Surface_results<Tdouble>& surface)
+    {
+        RNG::Mrg32k_RNG rng;
+        return MC_European_CallOption_Replay_AAD(spot, r, q, strike, mat, surface, rng, bench_paths_);
+    });
+    report_replay("autocall tape", autocall(MC_Auto_Callable_AAD));
+    report_replay("autocall replay", autocall(MC_Auto_Callable_Replay_AAD));
+}
+
+// Multithreaded AAD: time and results by number of threads, results must be identical to one thread
+void bench_parallel()
+{
+    std::cout << "parallel: autocall, " << bench_paths_ * 5 << " paths, chunks of 4096 paths" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "price" << std::setw(12) << "delta" 
+              << std::setw(12) << "vega" << std::setw(12) << "ms" << std::setw(12) << "identical" << std::endl;
+
+    double price_1 = 0, delta_1 = 0, vega_1 = 0;
+    // at least 4 threads to check the results on small machines
+    const size_t max_threads = std::max<size_t>(4, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        Tdouble::tape->clear();
+        Tdouble spot = bench_spot_, r = 0., q = 0., coupon = 10., upper = 120., lower = 50., anchor = 100.;
+        for (Tdouble* input : {&spot, &r, &q, &coupon, &upper, &lower, &anchor}) input->put_on_tape();
+        std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+        auto surface = flat_surface(33);
+
+        Parallel_settings settings;
+        settings.threads = threads;
+        auto start = std::chrono::steady_clock::now();
+        const double price = MC_Auto_Callable_Parallel_AAD(spot, r, q, coupon, upper, lower, anchor, times, surface,
+            [](const size_t chunk){return RNG::Mrg32k_RNG::stream(0, chunk);}, bench_paths_ * 5, 5., settings);
+        auto stop  = std::chrono::steady_clock::now();
+
+        double vega = 0;
+        for (auto& vol : surface.lVol) vega += vol.get_adjoint();
+        if (threads == 1) {price_1 = price; delta_1 = spot.get_adjoint(); vega_1 = vega;}
+
+        std::cout << std::setw(8) << threads
+                  << std::setw(12) << price
+                  << std::setw(12) << spot.get_adjoint()
+                  << std::setw(12) << vega
+                  << std::setw(12) << std::chrono::duration<double, std::milli>(stop - start).count()
+                  << std::setw(12) << (price == price_1 && spot.get_adjoint() == delta_1 && vega == vega_1 ? "yes" : "no")
+                  << std::endl;
+    }
+}
+
+// Multithreaded double pricers (see parallel_MC in Parallel.hpp): time by number of threads, price must be
+// identical to one thread
+void bench_parallel_double()
+{
+    const size_t paths = bench_paths_ * 5;
+    std::cout << "parallel double: autocall, " << paths << " paths, chunks of 4096 paths" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "price" << std::setw(12) << "ms" << std::setw(12) << "identical" << std::endl;
+
+    double spot = bench_spot_, r = 0., q = 0., coupon = 10., upper = 120., lower = 50., anchor = 100.;
+    std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+    auto surface = skew_surface(33);
+
+    double price_1 = 0;
+    const size_t max_threads = std::max<size_t>(4, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        Parallel_settings settings;
+        settings.threads = threads;
+        auto start = std::chrono::steady_clock::now();
+        const double price = MC_Auto_Callable_Parallel(spot, r, q, coupon, upper, lower, anchor, times, surface,
+            [](const size_t chunk){return RNG::Mrg32k_RNG::stream(0, chunk);}, paths, 5., settings);
+        auto stop  = std::chrono::steady_clock::now();
+        if (threads == 1) price_1 = price;
+
+        std::cout << std::setw(8) << threads
+                  << std::setw(12) << price
+                  << std::setw(12) << std::chrono::duration<double, std::milli>(stop - start).count()
+                  << std::setw(12) << (price == price_1 ? "yes" : "no") << std::endl;
+    }
+}
+
+// Gaussians per path (nextG) vs. in blocks of paths (nextG_block): time per gaussian, numbers must be identical.
+// nextG is a block of one path, so the two are close: the block saves the call per path only. The split below
+// is where the time goes: the uniforms (half of them antithetic mirrors), and the inverse normal scalar vs. by
+// block (the central part vectorises, the tails, about 16% of the draws, call log twice and do not). nextG_block
+// only inverts the drawn rows and negates their mirrors, so it costs less than the sum.
+void bench_rng()
+{
+    const size_t dim = bench_mats_steps_, paths = bench_paths_ * 10, block = 256;
+    std::vector<double> by_path(paths * dim), by_block(paths * dim), gaussians(dim);
+    std::cout << "rng: " << paths << " paths of " << dim << " gaussians" << std::endl;
+
+    RNG::Mrg32k_RNG rng;
+    rng.init(dim);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < paths; ++i)
+    {
+        rng.nextG(gaussians);
+        std::copy(gaussians.begin(), gaussians.end(), &by_path[i * dim]);
+    }
+    auto stop  = std::chrono::steady_clock::now();
+    const double path_ns = std::chrono::duration<double, std::nano>(stop - start).count() / (paths * dim);
+
+    rng.reset_members();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < paths; i += block) rng.nextG_block(&by_block[i * dim], std::min(block, paths - i));
+    stop  = std::chrono::steady_clock::now();
+    const double block_ns = std::chrono::duration<double, std::nano>(stop - start).count() / (paths * dim);
+
+    std::cout << std::setw(16) << "ns nextG" << std::setw(16) << "ns nextG_block" << std::setw(12) << "identical" << std::endl;
+    std::cout << std::setw(16) << path_ns << std::setw(16) << block_ns << std::setw(12) << (by_path == by_block ? "yes" : "no") << std::endl;
+
+    // the split: uniforms (antithetic included, as above), then the inverse normal of the same uniforms
+    std::vector<double>& uniforms = by_path;
+    rng.reset_members();
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < paths; i += block) rng.nextU_block(&uniforms[i * dim], std::min(block, paths - i));
+    stop  = std::chrono::steady_clock::now();
+    const double uniform_ns = std::chrono::duration<double, std::nano>(stop - start).count() / (paths * dim);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < paths * dim; ++k) by_block[k] = gaussian::invNormalCdf(uniforms[k]);
+    stop  = std::chrono::steady_clock::now();
+    const double scalar_ns = std::chrono::duration<double, std::nano>(stop - start).count() / (paths * dim);
+
+    start = std::chrono::steady_clock::now();
+    gaussian::invNormalCdf(uniforms.data(), uniforms.data(), paths * dim);
+    stop  = std::chrono::steady_clock::now();
+    const double inverse_ns = std::chrono::duration<double, std::nano>(stop - start).count() / (paths * dim);
+
+    std::cout << std::setw(16) << "ns uniform" << std::setw(16) << "ns inv scalar" << std::setw(16) << "ns inv block" << std::endl;
+    std::cout << std::setw(16) << uniform_ns << std::setw(16) << scalar_ns << std::setw(16) << inverse_ns << std::endl;
+}
+
+// Pseudo vs. quasi random on skew_surface(): standard error of the price over 16 independent runs of
+// 4096 paths, MRG32k3a substreams (antithetic) vs. digitally shifted Sobol with a Brownian bridge, and the
+// factor of paths MC needs for the same error ((se MC / se Sobol)^2)
+void bench_quasi_random()
+{
+    const size_t paths = 4096, runs = 16;
+    Surface_results<double> surface = skew_surface(33);
+    const std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+    std::cout << "quasi random: " << runs << " runs of " << paths << " paths" << std::endl;
+    std::cout << std::setw(10) << "product" << std::setw(12) << "price" << std::setw(12) << "se MC"
+              << std::setw(12) << "se Sobol" << std::setw(12) << "paths x" << std::endl;
+
+    // mean and standard error of the mean of runs prices
+    auto standard_error = [runs](auto price_of_run, double& mean)
+    {
+        double sum = 0, sum2 = 0;
+        for (size_t run = 0; run < runs; ++run)
+        {
+            const double price = price_of_run(run);
+            sum  += price;
+            sum2 += price * price;
+        }
+        mean = sum / runs;
+        return sqrt((sum2 / runs - mean * mean) / (runs - 1));
+    };
+
+    auto report = [&](const std::string& name, auto pricer)
+    {
+        double mc_mean = 0, qmc_mean = 0;
+        const double mc = standard_error([&](const size_t run)
+        {
+            RNG::Mrg32k_RNG rng = RNG::Mrg32k_RNG::stream(0, run);
+            return pricer(rng);
+        }, mc_mean);
+        const double qmc = standard_error([&](const size_t run)
+        {
+            RNG::Sobol sobol(unsigned(run) + 1);
+            RNG::Brownian_bridge bridge(sobol, surface.mats);
+            return pricer(bridge);
+        }, qmc_mean);
+
+        std::cout << std::setw(10) << name << std::setw(12) << qmc_mean << std::setw(12) << mc
+                  << std::setw(12) << qmc << std::setw(12) << (mc / qmc) * (mc / qmc) << std::endl;
+    };
+
+    double spot = bench_spot_, r = 0., q = 0., strike = bench_strike_, mat = bench_mat_, upper = 150.;
+    double coupon = 10., autocall = 120., lower = 50., anchor = 100.;
+    report("call", [&](RNG::RNG_base& rng)
+        {return MC_European_CallOption(spot, r, q, strike, mat, surface, rng, paths);});
+    report("barrier", [&](RNG::RNG_base& rng)
+        {return MC_European_Barrier(spot, r, q, strike, mat, upper, surface, rng, paths, 5.);});
+    report("autocall", [&](RNG::RNG_base& rng)
+        {return MC_Auto_Callable(spot, r, q, coupon, autocall, lower, anchor, times, surface, rng, paths, 5.);});
+}
+
+// Counter based Philox (see Philox.hpp): known answers of Random123, time per gaussian in blocks vs.
+// MRG32k3a (which only draws every other path, the others are antithetic), a path regenerated alone,
+// and the parallel autocall with one key for any chunk size
+void bench_philox()
+{
+    struct Philox_check {RNG::Philox_RNG::counter_t counter; RNG::Philox_RNG::key_t key; RNG::Philox_RNG::counter_t result;};
+    const Philox_check known[] = {
+        {{0, 0, 0, 0}, {0, 0}, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}, {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}, {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}};
+    bool known_ok = true;
+    for (const auto& check : known) known_ok &= RNG::Philox_RNG::philox(check.counter, check.key) == check.result;
+
+    const size_t dim = bench_mats_steps_, paths = bench_paths_ * 10, block = 256;
+    std::vector<double> gaussians(paths * dim);
+    auto ns_per_gaussian = [&](RNG::RNG_base& rng)
+    {
+        rng.init(dim);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < paths; i += block) rng.nextG_block(&gaussians[i * dim], std::min(block, paths - i));
+        auto stop  = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(stop - start).count() / (paths * dim);
+    };
+    RNG::Mrg32k_RNG mrg;
+    const double mrg_ns = ns_per_gaussian(mrg);
+    RNG::Philox_RNG philox(42);
+    const double philox_ns = ns_per_gaussian(philox);
+
+    // path 12345 alone
+    bool replay_ok = true;
+    for (size_t j = 0; j < dim; ++j) replay_ok &= philox.gaussian(12345, j) == gaussians[12345 * dim + j];
+
+    std::cout << "philox: " << paths << " paths of " << dim << " gaussians, known answers " << (known_ok ? "ok" : "FAILED")
+              << ", path replay " << (replay_ok ? "ok" : "FAILED") << std::endl;
+    std::cout << std::setw(16) << "ns MRG32k3a" << std::setw(16) << "ns Philox" << std::endl;
+    std::cout << std::setw(16) << mrg_ns << std::setw(16) << philox_ns << std::endl;
+
+    // the same paths for any chunk size, the prices only differ by the order of the sums
+    double spot = bench_spot_, r = 0., q = 0., coupon = 10., upper = 120., lower = 50., anchor = 100.;
+    std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+    auto surface = skew_surface(33);
+    std::cout << std::setw(12) << "chunk paths" << std::setw(16) << "autocall" << std::endl;
+    for (const size_t chunk_paths : {1024, 4096, 10000})
+    {
+        Parallel_settings settings;
+        settings.chunk_paths = chunk_paths;
+        const double price = MC_Auto_Callable_Parallel(spot, r, q, coupon, upper, lower, anchor, times, surface,
+            [chunk_paths](const size_t chunk){return RNG::Philox_RNG(42, chunk * chunk_paths);}, bench_paths_, 5., settings);
+        std::cout << std::setw(12) << chunk_paths << std::setw(16) << std::setprecision(12) << price << std::setprecision(6) << std::endl;
+    }
+}
+
+// Implied vol surface of Black-Scholes prices: each cell records its price from a vol leaf and the implied
+// vol as one node (implicit function adjoint, see Black_Scholes_Ivol()). The round trip is the identity,
+// so every vol leaf gets adjoint 1 and spot 0 from the sum of the implied vols.
+void bench_implied_vol()
+{
+    const auto strikes = tools::seq(40., 200., 33.);
+    const auto mats    = tools::seq(0., bench_mat_, 72.);
+    std::cout << "implied vol: " << strikes.size() << " x " << mats.size() << " surface of Black-Scholes prices" << std::endl;
+
+    Tdouble::tape->clear();
+    Tdouble spot = bench_spot_;
+    spot.put_on_tape();
+    Matrix<Tdouble> vols(mats.size(), strikes.size());
+    for (auto& vol : vols) {vol = bench_vol_; vol.put_on_tape();}
+
+    // cells with a price above intrinsic, where the implied vol is solved
+    std::vector<bool> solved;
+    size_t ivol_nodes = 0;
+    Tdouble sum = 0.;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < mats.size(); ++i)
+    {
+        for (size_t j = 0; j < strikes.size(); ++j)
+        {
+            const Tdouble price = Black_scholes<Tdouble>(spot, strikes[j], vols[i][j], mats[i]);
+            const size_t nodes = Tdouble::tape->nodes();
+            const Tdouble ivol = Black_Scholes_Ivol(spot, strikes[j], price, mats[i]);
+            ivol_nodes += Tdouble::tape->nodes() - nodes;
+            solved.push_back(ivol.is_active());
+            sum += ivol;
+        }
+    }
+    auto mid = std::chrono::steady_clock::now();
+    sum.propagate_to_start();
+    auto stop = std::chrono::steady_clock::now();
+
+    double max_error = 0;
+    size_t k = 0;
+    for (auto& vol : vols) if (solved[k++]) max_error = std::max(max_error, std::abs(vol.get_adjoint() - 1.));
+    const size_t cells = strikes.size() * mats.size();
+    std::cout << std::setw(16) << "nodes/cell" << std::setw(16) << "ivol nodes/cell" << std::setw(14) << "forward ms" 
+              << std::setw(14) << "reverse ms" << std::setw(16) << "max |dvol - 1|" << std::setw(12) << "dspot" << std::endl;
+    std::cout << std::setw(16) << double(Tdouble::tape->nodes()) / cells
+              << std::setw(16) << double(ivol_nodes) / cells
+              << std::setw(14) << std::chrono::duration<double, std::milli>(mid - start).count()
+              << std::setw(14) << std::chrono::duration<double, std::milli>(stop - mid).count()
+              << std::setw(16) << max_error
+              << std::setw(12) << spot.get_adjoint() << std::endl;
+    std::cout << std::count(solved.begin(), solved.end(), true) << " of " << cells << " cells solved" << std::endl;
+}
+
+// Bates parameter risk of an MC call priced on the local vol surface of the model: one AAD run through
+// Generate_surface<Tdouble> (the Fourier integrals and Dupire, see Surface_point()) and the MC, vs. the
+// 22 double runs of central bumps, each regenerating the surface and repricing.
+// Two checks, the bench fails if either disagrees:
+// - Batescf_call, smooth in the parameters (fixed quadrature nodes): the AAD gradient of the call of every
+//   cell against central bumps of 1e-5.
+// - Surface_point, the implied and local vol of every cell the surface keeps (not flat extrapolated),
+//   against central bumps of 1e-2. Dupire's second difference with tol = 1e-4 loses its digits where
+//   C(K - tol) + C(K + tol) - 2 C(K) < 1e-13 K, for the tape and the bumps alike, and lVol is only checked
+//   where it is larger. Bumps that move by more than 1% from h to 2h are noise and skipped.
+// The price bumps are no reference: cells near the 0.02 jump test of Generate_surface switch between their
+// own value and the flat extrapolation under a bump, and the MC sees the noise of the wing cells.
+void bench_model_risk()
+{
+    const size_t paths = 5000;
+    const auto spots = tools::seq(40., 200., 17.);
+    const auto mats  = tools::seq(0., bench_mat_, 6.);
+    const char* names[11] = {"spot", "r", "q", "v0", "vT", "rho", "kappa", "sigma", "intens", "jump_mean", "jump_std"};
+    const std::array<double, 11> params = {bench_spot_, 0., 0., 0.04, 0.05, -0.7, 1., 0.2, 1., 0.05, 0.05};
+    std::cout << "model risk: Bates parameters of an MC call, " << spots.size() << " spots x " << mats.size() 
+              << " mats surface, " << paths << " paths" << std::endl;
+
+    // AAD of the call of every cell on the surface grid vs. central bumps
+    double max_error = 0;
+    {
+        Tdouble::tape->clear();
+        std::array<Tdouble, 11> x;
+        for (size_t k = 0; k < 11; ++k) {x[k] = params[k]; x[k].put_on_tape();}
+        Tdouble::set_mark();
+        auto call_price = [](const auto& p, const double strike, const double mat)
+        {
+            return Batescf_call(p[0], strike, mat, p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10]);
+        };
+        for (const double mat : mats)
+        {
+            for (const double strike : spots)
+            {
+                Tdouble price = call_price(x, strike, mat);
+                price.propagate_to_mark();
+                for (size_t k = 0; k < 11; ++k)
+                {
+                    const double h = 1.e-5 * std::max(1., std::abs(params[k]));
+                    std::array<double, 11> up = params, down = params;
+                    up[k] += h;
+                    down[k] -= h;
+                    const double bumped = (call_price(up, strike, mat) - call_price(down, strike, mat)) / (2. * h);
+                    max_error = std::max(max_error, std::abs(x[k].get_adjoint() - bumped) / std::max(1., std::abs(bumped)));
+                    x[k].get_adjoint() = 0;
+                }
+                Tdouble::set_to_mark();
+            }
+        }
+    }
+    std::cout << "call per cell, max relative |AAD - bump| " << max_error << std::endl;
+    if (!(max_error < 1.e-6)) std::__throw_runtime_error("bench_model_risk: AAD and bumps of Batescf_call disagree");
+
+    // AAD of the implied and local vol of every cell kept by the surface vs. central bumps, both vols in one
+    // vector mode sweep per cell
+    double max_ivol_error = 0, max_lvol_error = 0;
+    size_t checked = 0, skipped = 0;
+    {
+        auto vols = [](const auto& p, const double spot, const double mat)
+        {
+            Bates<std::decay_t<decltype(p[0])>> model(p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10]);
+            return Surface_point(model, spot, mat);
+        };
+        Bates<double> model(params[0], params[1], params[2], params[3], params[4], params[5], params[6], params[7], params[8], params[9], params[10]);
+        const auto surface = Generate_surface(model, spots, mats);
+        const double tol = 1.e-4;
+        for (size_t i = 0; i < mats.size(); ++i)
+        {
+            for (size_t j = 0; j < spots.size(); ++j)
+            {
+                const std::array<double, 2> value = vols(params, spots[j], mats[i]);
+                if (value[0] != surface.iVol[i][j] || value[1] != surface.lVol[i][j]) continue;
+                const double second_difference = model.call(spots[j] - tol, mats[i]) + model.call(spots[j] + tol, mats[i]) 
+                                               - 2. * model.call(spots[j], mats[i]);
+                const bool resolved = second_difference >= 1.e-13 * spots[j];
+
+                Tdouble::tape->clear();
+                std::array<Tdouble, 11> x;
+                for (size_t k = 0; k < 11; ++k) {x[k] = params[k]; x[k].put_on_tape();}
+                Tdouble::propagate_to_start(vols(x, spots[j], mats[i]));
+                for (size_t k = 0; k < 11; ++k)
+                {
+                    // bumped[n] with h * (n + 1)
+                    std::array<double, 2> bumped[2];
+                    for (size_t n = 0; n < 2; ++n)
+                    {
+                        const double h = 1.e-2 * (n + 1.) * std::max(1., std::abs(params[k]));
+                        std::array<double, 11> up = params, down = params;
+                        up[k] += h;
+                        down[k] -= h;
+                        const std::array<double, 2> vols_up = vols(up, spots[j], mats[i]), vols_down = vols(down, spots[j], mats[i]);
+                        for (size_t l = 0; l < 2; ++l) bumped[n][l] = (vols_up[l] - vols_down[l]) / (2. * h);
+                    }
+                    for (size_t l = 0; l < 2; ++l)
+                    {
+                        const double scale = std::max(1., std::abs(bumped[0][l]));
+                        if ((l && !resolved) || !(std::abs(bumped[0][l] - bumped[1][l]) <= 1.e-2 * scale)) {++skipped; continue;}
+                        ++checked;
+                        double& error = l ? max_lvol_error : max_ivol_error;
+                        error = std::max(error, std::abs(x[k].get_adjoint(l) - bumped[0][l]) / scale);
+                    }
+                }
+            }
+        }
+    }
+    std::cout << "vols per cell, max relative |AAD - bump| iVol " << max_ivol_error << ", lVol " << max_lvol_error 
+              << " (" << checked << " checked, " << skipped << " skipped)" << std::endl;
+    if (!(max_ivol_error < 1.e-2 && max_lvol_error < 5.e-2)) std::__throw_runtime_error("bench_model_risk: AAD and bumps of Surface_point disagree");
+
+    Tdouble::tape->clear();
+    std::array<Tdouble, 11> x;
+    for (size_t k = 0; k < 11; ++k) {x[k] = params[k]; x[k].put_on_tape();}
+    Tdouble strike = bench_strike_, mat = bench_mat_;
+
+    auto start = std::chrono::steady_clock::now();
+    Bates<Tdouble> model(x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7], x[8], x[9], x[10]);
+    double call_mat = bench_mat_;
+    products::European_Call<double> call(call_mat);
+    auto surface = Generate_surface(model, spots, mats, call);
+    auto mid   = std::chrono::steady_clock::now();
+    RNG::Mrg32k_RNG rng;
+    const double price = MC_European_CallOption_AAD(x[0], x[1], x[2], strike, mat, surface, rng, paths);
+    auto stop  = std::chrono::steady_clock::now();
+    const size_t surface_nodes = Tdouble::tape->mark_nodes();
+
+    // one double run, a bump regenerates the surface and reprices
+    auto double_start = std::chrono::steady_clock::now();
+    Bates<double> double_model(params[0], params[1], params[2], params[3], params[4], params[5], params[6], params[7], params[8], params[9], params[10]);
+    products::European_Call<double> double_call(call_mat);
+    auto double_surface = Generate_surface(double_model, spots, mats, double_call);
+    double double_strike = bench_strike_, double_mat = bench_mat_;
+    RNG::Mrg32k_RNG double_rng;
+    const double price_0 = MC_European_CallOption(params[0], params[1], params[2], double_strike, double_mat, double_surface, double_rng, paths);
+    auto double_stop = std::chrono::steady_clock::now();
+
+    std::cout << std::setw(12) << "param" << std::setw(14) << "AAD" << std::endl;
+    for (size_t k = 0; k < 11; ++k) std::cout << std::setw(12) << names[k] << std::setw(14) << x[k].get_adjoint() << std::endl;
+    std::cout << "price AAD " << price << ", double " << price_0 << ", surface nodes on tape " << surface_nodes << std::endl;
+    std::cout << "AAD: surface " << std::chrono::duration<double, std::milli>(mid - start).count() 
+              << " ms, MC " << std::chrono::duration<double, std::milli>(stop - mid).count() 
+              << " ms; one double run " << std::chrono::duration<double, std::milli>(double_stop - double_start).count() 
+              << " ms, 22 for central bumps" << std::endl;
+}
+
+// Tape-free adjoint kernels vs. the tape pricers on skew_surface(): price, max difference of the scalar and local vol adjoints, and time per path
+// of the double pricer, the tape pricer and the kernel.
+void bench_adjoint_kernel()
+{
+    std::cout << "adjoint kernel: hand written adjoints vs. tape" << std::endl;
+    std::cout << std::setw(10) << "product" << std::setw(12) << "price" << std::setw(14) << "max |d adj|" 
+              << std::setw(14) << "max |d lVol|" << std::setw(12) << "double us" << std::setw(12) << "tape us" 
+              << std::setw(12) << "kernel us" << std::endl;
+
+    Surface_results<double> surface = skew_surface(33);
+
+    const size_t paths = bench_paths_;
+    const std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+    auto us_per_path = [paths](auto f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto stop  = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(stop - start).count() / paths;
+    };
+
+    // Runs the tape pricer with the scalar inputs on tape and compares with the kernel adjoints
+    auto report = [&](const std::string& name, auto double_pricer, auto tape_pricer, auto kernel, 
+                      std::vector<double> inputs, std::vector<double MC_adjoints::*> adjoint_of)
+    {
+        const double double_us = us_per_path([&]{double_pricer(inputs);});
+
+        Tdouble::tape->clear();
+        std::vector<Tdouble> t_inputs(inputs.begin(), inputs.end());
+        for (auto& input : t_inputs) input.put_on_tape();
+        auto t_surface = Convert_to_Tdouble(surface);
+        double tape_price = 0;
+        const double tape_us = us_per_path([&]{tape_price = tape_pricer(t_inputs, t_surface);});
+        const Matrix<double> tape_lVol = Get_adjoints_SR(t_surface).lVol;
+
+        MC_adjoints adjoints;
+        double price = 0;
+        const double kernel_us = us_per_path([&]{price = kernel(inputs, adjoints);});
+
+        double max_adj = std::abs(price - tape_price), max_lVol = 0;
+        for (size_t k = 0; k < adjoint_of.size(); ++k) if (adjoint_of[k])
+            max_adj = std::max(max_adj, std::abs(adjoints.*adjoint_of[k] - t_inputs[k].get_adjoint()));
+        for (size_t i = 0; i < tape_lVol.get_rows(); ++i)
+            for (size_t j = 0; j < tape_lVol.get_cols(); ++j)
+                max_lVol = std::max(max_lVol, std::abs(adjoints.lVol[i][j] - tape_lVol[i][j]));
+
+        std::cout << std::setw(10) << name << std::setw(12) << price << std::setw(14) << max_adj 
+                  << std::setw(14) << max_lVol << std::setw(12) << double_us << std::setw(12) << tape_us 
+                  << std::setw(12) << kernel_us << std::endl;
+    };
+
+    // inputs: spot, rate, divs, strike, mat (mat has no adjoint)
+    report("call",
+        [&](std::vector<double> x){RNG::Mrg32k_RNG rng; return MC_European_CallOption(x[0], x[1], x[2], x[3], x[4], surface, rng, paths);},
+        [&](std::vector<Tdouble>& x, Surface_results<Tdouble>& s){RNG::Mrg32k_RNG rng; return MC_European_CallOption_AAD(x[0], x[1], x[2], x[3], x[4], s, rng, paths);},
+        [&](std::vector<double> x, MC_adjoints& a){RNG::Mrg32k_RNG rng; return MC_European_CallOption_Adjoint(x[0], x[1], x[2], x[3], x[4], surface, rng, paths, a);},
+        {bench_spot_, 0.02, 0.01, bench_strike_, bench_mat_},
+        {&MC_adjoints::spot, &MC_adjoints::rate, &MC_adjoints::divs, &MC_adjoints::strike});
+
+    // inputs: spot, rate, divs, strike, mat, upper (mat has no adjoint)
+    report("barrier",
+        [&](std::vector<double> x){RNG::Mrg32k_RNG rng; return MC_European_Barrier(x[0], x[1], x[2], x[3], x[4], x[5], surface, rng, paths, 5.);},
+        [&](std::vector<Tdouble>& x, Surface_results<Tdouble>& s){RNG::Mrg32k_RNG rng; return MC_European_Barrier_AAD(x[0], x[1], x[2], x[3], x[4], x[5], s, rng, paths, 5.);},
+        [&](std::vector<double> x, MC_adjoints& a){RNG::Mrg32k_RNG rng; return MC_European_Barrier_Adjoint(x[0], x[1], x[2], x[3], x[4], x[5], surface, rng, paths, 5., a);},
+        {bench_spot_, 0.02, 0.01, 90., bench_mat_, 130.},
+        {&MC_adjoints::spot, &MC_adjoints::rate, &MC_adjoints::divs, &MC_adjoints::strike, nullptr, &MC_adjoints::upper});
+
+    // inputs: spot, rate, divs, coupon, upper, lower, anchor
+    report("autocall",
+        [&](std::vector<double> x){RNG::Mrg32k_RNG rng; return MC_Auto_Callable(x[0], x[1], x[2], x[3], x[4], x[5], x[6], times, surface, rng, paths, 5.);},
+        [&](std::vector<Tdouble>& x, Surface_results<Tdouble>& s){RNG::Mrg32k_RNG rng; return MC_Auto_Callable_Checkpointed_AAD(x[0], x[1], x[2], x[3], x[4], x[5], x[6], times, s, rng, paths, 5., Checkpoint_budget{0, 1 << 30});},
+        [&](std::vector<double> x, MC_adjoints& a){RNG::Mrg32k_RNG rng; return MC_Auto_Callable_Adjoint(x[0], x[1], x[2], x[3], x[4], x[5], x[6], times, surface, rng, paths, 5., a);},
+        {bench_spot_, 0.02, 0.01, 10., 120., 50., 100.},
+        {&MC_adjoints::spot, &MC_adjoints::rate, &MC_adjoints::divs, &MC_adjoints::coupon, &MC_adjoints::upper, &MC_adjoints::lower, &MC_adjoints::anchor});
+}
+
+// Mixed precision tape (Tape::set_float_weights()): errors of the float weight greeks against double weights
+// on skew_surface(), relative to the largest greek of each kind, and the reverse sweep of big tapes.
+void bench_mixed_precision()
+{
+    std::cout << "mixed precision: float weights vs. double weights, relative errors" << std::endl;
+    std::cout << std::setw(10) << "product" << std::setw(12) << "price" << std::setw(12) << "delta" 
+              << std::setw(12) << "price err" << std::setw(12) << "input err" << std::setw(12) << "lVol err" << std::endl;
+
+    const Surface_results<double> surface = skew_surface(33);
+    const std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+
+    // Price, input adjoints and local vol adjoints of a tape pricer, weights in float or double
+    auto run = [&](const bool float_weights, auto pricer, std::vector<double> inputs)
+    {
+        Tdouble::tape->set_float_weights(float_weights);
+        std::vector<Tdouble> t_inputs(inputs.begin(), inputs.end());
+        for (auto& input : t_inputs) input.put_on_tape();
+        auto t_surface = Convert_to_Tdouble(surface);
+
+        RNG::Mrg32k_RNG rng;
+        std::vector<double> res = {pricer(t_inputs, t_surface, rng)};
+        for (auto& input : t_inputs) res.push_back(input.get_adjoint());
+        for (auto& vol : t_surface.lVol) res.push_back(vol.get_adjoint());
+        return res;
+    };
+
+    auto report = [&](const std::string& name, auto pricer, std::vector<double> inputs)
+    {
+        const std::vector<double> full  = run(false, pricer, inputs);
+        const std::vector<double> mixed = run(true, pricer, inputs);
+
+        // max error over [begin, end) relative to the max magnitude
+        auto error = [&](const size_t begin, const size_t end)
+        {
+            double err = 0, scale = 0;
+            for (size_t k = begin; k < end; ++k)
+            {
+                err   = std::max(err, std::abs(mixed[k] - full[k]));
+                scale = std::max(scale, std::abs(full[k]));
+            }
+            return scale ? err / scale : err;
+        };
+
+        std::cout << std::setw(10) << name << std::setw(12) << full[0] << std::setw(12) << full[1]
+                  << std::setw(12) << error(0, 1) 
+                  << std::setw(12) << error(1, 1 + inputs.size())
+                  << std::setw(12) << error(1 + inputs.size(), full.size()) << std::endl;
+    };
+
+    report("call", [](std::vector<Tdouble>& x, Surface_results<Tdouble>& s, RNG::RNG_base& rng)
+        {return MC_European_CallOption_AAD(x[0], x[1], x[2], x[3], x[4], s, rng, bench_paths_);},
+        {bench_spot_, 0.02, 0.01, bench_strike_, bench_mat_});
+    report("barrier", [](std::vector<Tdouble>& x, Surface_results<Tdouble>& s, RNG::RNG_base& rng)
+        {return MC_European_Barrier_AAD(x[0], x[1], x[2], x[3], x[4], x[5], s, rng, bench_paths_, 5.);},
+        {bench_spot_, 0.02, 0.01, 90., bench_mat_, 130.});
+    report("autocall", [&](std::vector<Tdouble>& x, Surface_results<Tdouble>& s, RNG::RNG_base& rng)
+        {return MC_Auto_Callable_Checkpointed_AAD(x[0], x[1], x[2], x[3], x[4], x[5], x[6], times, s, rng, bench_paths_, 5., Checkpoint_budget{0, 1 << 30});},
+        {bench_spot_, 0.02, 0.01, 10., 120., 50., 100.});
+
+    // Reverse sweep of one tape of n nodes with 3 arguments each, by storage: tape MB and ns per argument.
+    // Float weights save memory, the sweep times are the same within noise (child ids, adjoints and
+    // arg_begin are read as before)
+    std::cout << "mixed precision: reverse sweep, ns per argument" << std::endl;
+    std::cout << std::setw(10) << "nodes" << std::setw(12) << "double MB" << std::setw(12) << "double" 
+              << std::setw(12) << "float MB" << std::setw(12) << "float" << std::endl;
+    for (size_t n : {size_t(1) << 14, size_t(1) << 17, size_t(1) << 20, size_t(1) << 23})
+    {
+        std::cout << std::setw(10) << n;
+        for (const bool float_weights : {false, true})
+        {
+            Tdouble::tape->set_float_weights(float_weights);
+            // x stays 1, no overflow or denormals in the sweep
+            Tdouble a = 0.5, b = 0.5, x = 1.;
+            for (Tdouble* input : {&a, &b, &x}) input->put_on_tape();
+            for (size_t i = 0; i < n; ++i) x = x * a + b * x;
+
+            // best of a few sweeps, each adds to the leaf adjoints
+            double best = 1e300;
+            for (size_t run = 0; run < 5; ++run)
+            {
+                auto start = std::chrono::steady_clock::now();
+                x.propagate_to_start();
+                auto stop  = std::chrono::steady_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count());
+            }
+            std::cout << std::setw(12) << Tdouble::tape->stats().bytes / double(1 << 20) 
+                      << std::setw(12) << best / Tdouble::tape->args();
+        }
+        std::cout << std::endl;
+    }
+    Tdouble::tape->set_float_weights(false);
+}
+
+// Resident memory of the process in MB (Linux), 0 if unknown
+double rss_mb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.rfind("VmRSS:", 0) == 0) return std::stod(line.substr(6)) / 1024.;
+    return 0;
+}
+
+// Out of core tape (Tape::set_memory_budget()): 8M node chain in memory vs. spilled to a scratch file in
+// /var/tmp under a 64MB budget. Resident memory after recording, leaf adjoints must be identical. The budget
+// is for the tape blocks: the RSS also holds the adjoints (64MB for 8M nodes, 128MB of vector capacity).
+void bench_out_of_core()
+{
+    std::cout << "out of core: 8M node tape, ms" << std::endl;
+    std::cout << std::setw(10) << "tape" << std::setw(12) << "record" << std::setw(12) << "propagate" 
+              << std::setw(12) << "tape MB" << std::setw(12) << "spilled MB" << std::setw(12) << "RSS MB" 
+              << std::setw(12) << "identical" << std::endl;
+
+    double adjoint_a = 0, adjoint_b = 0;
+    for (const size_t budget : {size_t(0), size_t(1) << 26})
+    {
+        Tdouble::tape->set_memory_budget(budget);
+        auto start = std::chrono::steady_clock::now();
+        Tdouble a = 1., b = 0.001, x = 1.;
+        for (Tdouble* input : {&a, &b, &x}) input->put_on_tape();
+        for (size_t i = 0; i < (size_t(1) << 23); ++i) x = x * a + b;
+        auto mid  = std::chrono::steady_clock::now();
+        const double rss = rss_mb();
+        x.propagate_to_start();
+        auto stop = std::chrono::steady_clock::now();
+
+        if (!budget) {adjoint_a = a.get_adjoint(); adjoint_b = b.get_adjoint();}
+        const containers::Spill_arena* spill = Tdouble::tape->spill();
+        std::cout << std::setw(10) << (budget ? "64MB" : "memory")
+                  << std::setw(12) << std::chrono::duration<double, std::milli>(mid - start).count()
+                  << std::setw(12) << std::chrono::duration<double, std::milli>(stop - mid).count()
+                  << std::setw(12) << Tdouble::tape->stats().bytes / double(1 << 20)
+                  << std::setw(12) << (spill ? spill->spilled() / double(1 << 20) : 0.)
+                  << std::setw(12) << rss
+                  << std::setw(12) << (a.get_adjoint() == adjoint_a && b.get_adjoint() == adjoint_b ? "yes" : "no")
+                  << std::endl;
+        Tdouble::tape->clear();
+    }
+    Tdouble::tape->set_memory_budget(0);
+}
+
+// Parallel reverse sweep of one tape (see Level_sweep.hpp): a call on 50000 local vol paths recorded
+// without marks, the payoffs summed into one price. Serial sweep vs. the analysis on one and on all hardware
+// threads, and the level sweep by number of threads: largest adjoint difference to the serial sweep (the
+// sums into hubs are reordered), whether the adjoints are identical to one thread, and the sweep
+// propagate() picks by the break-even estimates: one sweep never pays for the analysis, an analysed schedule
+// runs the levels only when the threads make up for the indirection.
+void bench_level_sweep()
+{
+    const size_t paths = 50000;
+    auto surface = flat_surface(33);
+    Tdouble spot = bench_spot_, mu = 0.;
+    for (Tdouble* input : {&spot, &mu}) input->put_on_tape();
+
+    const size_t steps = surface.mats.size();
+    std::vector<double> dts(steps), gaussians(steps);
+    dts[0] = surface.mats[0];
+    for (size_t j = 1; j < steps; ++j) dts[j] = surface.mats[j] - surface.mats[j - 1];
+
+    RNG::Mrg32k_RNG rng;
+    rng.init(steps);
+    Tdouble price = 0.;
+    for (size_t i = 0; i < paths; ++i)
+    {
+        rng.nextG(gaussians);
+        Tdouble s = spot;
+        for (size_t j = 0; j < steps; ++j) s = local_vol_step(surface.spots, surface.lVol[j], s, mu, dts[j], gaussians[j]);
+        price = price + fIf(s - bench_strike_, s - bench_strike_, 0., 1.) / double(paths);
+    }
+    const size_t last = price.get_index();
+    Tape& tape = *Tdouble::tape;
+    auto adjoints = [&]()
+    {
+        std::vector<double> res(last + 1);
+        for (size_t node = 0; node <= last; ++node) res[node] = tape.get_adjoint(Tape::index_t(node));
+        return res;
+    };
+
+    // serial sweep, the reference
+    auto start = std::chrono::steady_clock::now();
+    price.get_adjoint() = 1.;
+    tape.propagate(last, 0);
+    auto stop  = std::chrono::steady_clock::now();
+    const std::vector<double> serial = adjoints();
+
+    const size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    auto analysis_start = std::chrono::steady_clock::now();
+    Level_schedule schedule(tape, last, 0);
+    schedule.analyse(1);
+    auto analysis_stop  = std::chrono::steady_clock::now();
+    Level_schedule parallel_schedule(tape, last, 0);
+    parallel_schedule.analyse(std::max<size_t>(2, hardware));
+    auto parallel_stop  = std::chrono::steady_clock::now();
+
+    std::cout << "level sweep: " << last + 1 << " nodes, " << schedule.levels() << " levels, " << schedule.hubs() << " hubs, "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+    std::cout << std::setw(12) << "serial ms" << std::setw(12) 
+              << std::chrono::duration<double, std::milli>(stop - start).count() << std::endl;
+    std::cout << std::setw(12) << "analysis ms" << std::setw(12) 
+              << std::chrono::duration<double, std::milli>(analysis_stop - analysis_start).count() << " (1 thread), "
+              << std::chrono::duration<double, std::milli>(parallel_stop - analysis_stop).count() << " (" 
+              << std::max<size_t>(2, hardware) << " threads)" << std::endl;
+    std::cout << std::setw(12) << "build" << "  for 1 sweep: " << (Level_schedule::worth_building(hardware, 1) ? "yes" : "no") 
+              << ", for 100 sweeps: " << (Level_schedule::worth_building(hardware, 100) ? "yes" : "no") 
+              << " (" << hardware << " threads)" << std::endl;
+    std::cout << std::setw(12) << "threads" << std::setw(12) << "sweep ms" << std::setw(14) << "max rel diff" 
+              << std::setw(12) << "identical" << std::setw(12) << "propagate" << std::setw(12) << "ms" << std::endl;
+
+    std::vector<double> one_thread;
+    const size_t max_threads = std::max<size_t>(4, hardware);
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        for (size_t node = 0; node <= last; ++node) tape.get_adjoint(Tape::index_t(node)) = 0.;
+        price.get_adjoint() = 1.;
+
+        auto start = std::chrono::steady_clock::now();
+        schedule.sweep_levels(threads);
+        auto stop  = std::chrono::steady_clock::now();
+
+        const std::vector<double> res = adjoints();
+        if (threads == 1) one_thread = res;
+        for (size_t node = 0; node <= last; ++node) tape.get_adjoint(Tape::index_t(node)) = 0.;
+        price.get_adjoint() = 1.;
+        auto propagate_start = std::chrono::steady_clock::now();
+        schedule.propagate(threads);
+        auto propagate_stop  = std::chrono::steady_clock::now();
+
+        double diff = 0;
+        for (size_t node = 0; node <= last; ++node) 
+            diff = std::max(diff, std::abs(res[node] - serial[node]) / std::max(1., std::abs(serial[node])));
+
+        std::cout << std::setw(12) << threads
+                  << std::setw(12) << std::chrono::duration<double, std::milli>(stop - start).count()
+                  << std::setw(14) << diff
+                  << std::setw(12) << (res == one_thread ? "yes" : "no")
+                  << std::setw(12) << (schedule.pays_off(threads) ? "levels" : "serial")
+                  << std::setw(12) << std::chrono::duration<double, std::milli>(propagate_stop - propagate_start).count() << std::endl;
+    }
+
+    // a fresh schedule for one sweep is not analysed
+    for (size_t node = 0; node <= last; ++node) tape.get_adjoint(Tape::index_t(node)) = 0.;
+    price.get_adjoint() = 1.;
+    Level_schedule one_sweep(tape, last, 0);
+    start = std::chrono::steady_clock::now();
+    one_sweep.propagate(hardware, 1);
+    stop  = std::chrono::steady_clock::now();
+    std::cout << "one sweep on a fresh schedule: " << std::chrono::duration<double, std::milli>(stop - start).count() 
+              << " ms, analysed: " << (one_sweep.analysed() ? "yes" : "no") << std::endl;
+
+    for (size_t node = 0; node <= last; ++node) tape.get_adjoint(Tape::index_t(node)) = 0.;
+    price.get_adjoint() = 1.;
+    parallel_schedule.sweep_levels(1);
+    std::cout << "schedule analysed on " << std::max<size_t>(2, hardware) << " threads identical: " 
+              << (adjoints() == one_thread ? "yes" : "no") << std::endl;
+    tape.clear();
+}
+
+// Tape stats after an autocall pricing, as JSON
+void bench_stats()
+{
+    std::cout << "tape stats: autocall" << std::endl;
+    Tdouble::tape->clear();
+    Tdouble spot = bench_spot_, r = 0., q = 0., coupon = 10., upper = 120., lower = 50., anchor = 100.;
+    for (Tdouble* input : {&spot, &r, &q, &coupon, &upper, &lower, &anchor}) input->put_on_tape();
+    std::vector<double> times = {0.5, 1., 1.5, 2., 2.5, 3.};
+    auto surface = flat_surface(33);
+
+    RNG::Mrg32k_RNG rng;
+    MC_Auto_Callable_AAD(spot, r, q, coupon, upper, lower, anchor, times, surface, rng, bench_paths_, 5.);
+    Tdouble::tape->stats().write_json(std::cout);
+}
+
+int main()
+{
+    bench_propagate_to_mark();
+    bench_tape_layout();
+    bench_expressions();
+    bench_vector_mode();
+    bench_second_order();
+    bench_second_order_mc();
+    bench_checkpointing();
+    bench_repeated_pricing();
+    bench_arena();
+    bench_replay();
+    bench_parallel();
+    bench_parallel_double();
+    bench_rng();
+    bench_quasi_random();
+    bench_philox();
+    bench_implied_vol();
+    bench_model_risk();
+    bench_adjoint_kernel();
+    bench_mixed_precision();
+    bench_out_of_core();
+    bench_level_sweep();
+    bench_stats();
+    return 0;
+}
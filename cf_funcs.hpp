@@ -5,15 +5,29 @@
 #include <math.h>
 #include <functional>
 
+#include "Tcomplex.hpp"
+
 #define Pi 3.14159265358979323846
 
 using namespace std::literals::complex_literals; // so 1i is well-defined
 
+// Complex number type of the real number type T: std::complex<double> for double, Tcomplex for Tdouble
+template<typename T>
+struct complex_of {using type = std::complex<T>;};
+
+template<>
+struct complex_of<Tdouble> {using type = Tcomplex;};
+
+template<typename T>
+using cf_complex = typename complex_of<T>::type;
+
+// Midpoint rule, the area has the number type of f
 template<typename F>
-double integral(F f, double a, double b, int n)
+auto integral(F f, double a, double b, int n) -> decltype(f(a))
 {
+    using T = decltype(f(a));
     double step = (b - a) / n;  // width of each small rectangle
-    double area = 0.0;  // signed area
+    T area = 0.0;  // signed area
     for (int i = 0; i < n; i ++)
     {
         area += f(a + (i + 0.5) * step) * step; // sum up each small rectangle